@@ -0,0 +1,64 @@
+#ifndef CARTWRIGHT_ALIAS_TABLE_H
+#define CARTWRIGHT_ALIAS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Walker's alias method, built with Vose's algorithm. After an O(n) setup,
+// sample() picks index i with probability weight[i]/sum(weight) from a
+// single 64-bit random number: the high 32 bits choose a column and the low
+// 32 bits decide between the column and its alias.
+class alias_table {
+public:
+    alias_table() = default;
+    explicit alias_table(const std::vector<double> &weight) {
+        size_t n = weight.size();
+        double total = 0.0;
+        for(double w : weight) {
+            total += w;
+        }
+        threshold_.assign(n, UINT64_C(1) << 32);
+        alias_.resize(n);
+        for(size_t i=0;i<n;++i) {
+            alias_[i] = static_cast<uint32_t>(i);
+        }
+
+        // scaled probabilities average 1; split them into small and large
+        std::vector<double> p(n);
+        std::vector<uint32_t> small, large;
+        for(size_t i=0;i<n;++i) {
+            p[i] = weight[i]*n/total;
+            (p[i] < 1.0 ? small : large).push_back(static_cast<uint32_t>(i));
+        }
+        // fill each small column with its deficit from a large one
+        while(!small.empty() && !large.empty()) {
+            uint32_t s = small.back();
+            uint32_t l = large.back();
+            small.pop_back();
+            threshold_[s] = static_cast<uint64_t>(p[s]*4294967296.0);
+            alias_[s] = l;
+            p[l] -= 1.0-p[s];
+            if(p[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // leftovers are full columns up to rounding
+    }
+
+    size_t size() const {
+        return alias_.size();
+    }
+
+    size_t sample(uint64_t u) const {
+        uint64_t column = ((u >> 32)*alias_.size()) >> 32;
+        return ((u & UINT64_C(0xFFFFFFFF)) < threshold_[column]) ? column : alias_[column];
+    }
+
+private:
+    std::vector<uint64_t> threshold_;
+    std::vector<uint32_t> alias_;
+};
+
+#endif
@@ -0,0 +1,238 @@
+#include "checkpoint.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+/************************************************************
+ * File format                                              *
+ ************************************************************/
+
+// A checkpoint is a fixed header followed by the fitness plane (doubles),
+// the color plane (bytes), and the barrier cells (pairs of int32). Each
+// section starts at the offset recorded in the header, aligned for its
+// type, so a mapped file can be read in place. Numbers are stored in the
+// byte order of the machine; byte_order catches files from another one.
+// Bump checkpoint_version whenever the layout changes.
+
+namespace {
+
+const char checkpoint_magic[8] = {'M','C','M','X','L','I','I','\n'};
+constexpr uint32_t checkpoint_version = 1;
+constexpr uint32_t checkpoint_byte_order = 0x01020304;
+
+struct checkpoint_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t header_size;
+    int32_t width;
+    int32_t height;
+    uint32_t engine;
+    uint32_t neighborhood;
+    uint32_t boundary;
+    uint32_t dispersal;
+    uint32_t reserved;
+    double mu;
+    double dispersal_radius;
+    double jump_rate;
+    uint64_t seed;
+    uint64_t generation;
+    uint64_t rand_u;
+    uint64_t rand_w;
+    uint64_t num_null_cells;
+    uint64_t fitness_offset;
+    uint64_t color_offset;
+    uint64_t null_offset;
+    uint64_t file_size;
+};
+
+uint64_t align_up(uint64_t n, uint64_t a) {
+    return (n+a-1)/a*a;
+}
+
+// fill in the sizes and offsets of the sections
+void layout(checkpoint_header *h) {
+    uint64_t cells = static_cast<uint64_t>(h->width)*h->height;
+    h->header_size = sizeof(checkpoint_header);
+    h->fitness_offset = align_up(sizeof(checkpoint_header), alignof(double));
+    h->color_offset = h->fitness_offset + cells*sizeof(double);
+    h->null_offset = align_up(h->color_offset + cells, alignof(int32_t));
+    h->file_size = h->null_offset + h->num_null_cells*2*sizeof(int32_t);
+}
+
+bool write_all(FILE *out, const void *data, size_t size) {
+    return std::fwrite(data, 1, size, out) == size;
+}
+
+bool write_checkpoint(FILE *out, const checkpoint_header &h, const checkpoint_t &ck) {
+    const pop_t &pop = ck.pop;
+    const char zeros[8] = {};
+    bool ok = write_all(out, &h, sizeof(h));
+    ok = ok && write_all(out, zeros, h.fitness_offset-sizeof(h));
+    for(int y=0;ok && y<h.height;++y) {
+        ok = write_all(out, &pop.fitness[pop.index(0,y)], h.width*sizeof(double));
+    }
+    for(int y=0;ok && y<h.height;++y) {
+        ok = write_all(out, &pop.color[pop.index(0,y)], h.width);
+    }
+    uint64_t end = h.color_offset + static_cast<uint64_t>(h.width)*h.height;
+    ok = ok && write_all(out, zeros, h.null_offset-end);
+    for(auto it = ck.null_cells.begin(); ok && it != ck.null_cells.end(); ++it) {
+        int32_t xy[2] = {it->first, it->second};
+        ok = write_all(out, xy, sizeof(xy));
+    }
+    return ok;
+}
+
+} // namespace
+
+bool save_checkpoint(const std::string &name, const checkpoint_t &ck) {
+    checkpoint_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, checkpoint_magic, sizeof(h.magic));
+    h.version = checkpoint_version;
+    h.byte_order = checkpoint_byte_order;
+    h.width = ck.width;
+    h.height = ck.height;
+    h.engine = static_cast<uint32_t>(ck.arg.engine);
+    h.neighborhood = static_cast<uint32_t>(ck.arg.neighborhood);
+    h.boundary = static_cast<uint32_t>(ck.arg.boundary);
+    h.dispersal = static_cast<uint32_t>(ck.arg.dispersal);
+    h.mu = ck.mu;
+    h.dispersal_radius = ck.arg.dispersal_radius;
+    h.jump_rate = ck.arg.jump_rate;
+    h.seed = ck.arg.seed;
+    h.generation = ck.generation;
+    h.rand_u = ck.rand_state.first;
+    h.rand_w = ck.rand_state.second;
+    h.num_null_cells = ck.null_cells.size();
+    layout(&h);
+
+    std::string temp = name + ".tmp";
+    FILE *out = std::fopen(temp.c_str(), "wb");
+    if(out == nullptr) {
+        return false;
+    }
+    bool ok = write_checkpoint(out, h, ck);
+    // make sure the data is on disk before it replaces the old checkpoint
+    ok = (std::fflush(out) == 0) && ok;
+    ok = ok && (fsync(fileno(out)) == 0);
+    ok = (std::fclose(out) == 0) && ok;
+    if(!ok || std::rename(temp.c_str(), name.c_str()) != 0) {
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool load_checkpoint(const std::string &name, checkpoint_t *ck) {
+    int fd = open(name.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(checkpoint_header))) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return false;
+    }
+    const char *bytes = static_cast<const char*>(data);
+
+    // check that the header describes exactly this file
+    checkpoint_header h;
+    std::memcpy(&h, bytes, sizeof(h));
+    checkpoint_header expect = h;
+    bool ok = std::memcmp(h.magic, checkpoint_magic, sizeof(h.magic)) == 0
+        && h.version == checkpoint_version && h.byte_order == checkpoint_byte_order
+        && h.width > 0 && h.height > 0 && h.num_null_cells <= size
+        && h.engine <= static_cast<uint32_t>(engine_t::draw)
+        && h.neighborhood <= static_cast<uint32_t>(neighborhood_t::hex)
+        && h.boundary <= static_cast<uint32_t>(boundary_t::reflect)
+        && h.dispersal <= static_cast<uint32_t>(dispersal_t::exponential)
+        // the same limits the command line puts on the model
+        && std::isfinite(h.mu) && h.mu > 0.0
+        && std::isfinite(h.dispersal_radius) && h.dispersal_radius > 0.0
+        && h.jump_rate >= 0.0 && h.jump_rate <= 1.0;
+    if(ok) {
+        layout(&expect);
+        ok = std::memcmp(&h, &expect, sizeof(h)) == 0 && h.file_size == size;
+    }
+    if(!ok) {
+        munmap(data, size);
+        return false;
+    }
+
+    ck->width = h.width;
+    ck->height = h.height;
+    ck->mu = h.mu;
+    ck->arg.engine = static_cast<engine_t>(h.engine);
+    ck->arg.neighborhood = static_cast<neighborhood_t>(h.neighborhood);
+    ck->arg.boundary = static_cast<boundary_t>(h.boundary);
+    ck->arg.dispersal = static_cast<dispersal_t>(h.dispersal);
+    ck->arg.dispersal_radius = h.dispersal_radius;
+    ck->arg.jump_rate = h.jump_rate;
+    ck->arg.seed = h.seed;
+    ck->generation = h.generation;
+    ck->rand_state = {h.rand_u, h.rand_w};
+
+    ck->pop = pop_t(h.width, h.height);
+    pop_t &pop = ck->pop;
+    const double *fitness = reinterpret_cast<const double*>(bytes + h.fitness_offset);
+    const uint8_t *color = reinterpret_cast<const uint8_t*>(bytes + h.color_offset);
+    // colors index the counts and the palette, so none may exceed the null
+    // allele
+    uint64_t plane_nulls = 0;
+    for(uint64_t i=0;ok && i<static_cast<uint64_t>(h.width)*h.height;++i) {
+        ok = color[i] <= null_allele;
+        plane_nulls += (color[i] == null_allele);
+    }
+    for(int y=0;ok && y<h.height;++y) {
+        std::copy_n(fitness + y*h.width, h.width, pop.fitness.begin()+pop.index(0,y));
+        std::copy_n(color + y*h.width, h.width, pop.color.begin()+pop.index(0,y));
+    }
+    const int32_t *nulls = reinterpret_cast<const int32_t*>(bytes + h.null_offset);
+    ck->null_cells.clear();
+    // every null cell of the plane must be listed once, or clearing the
+    // barriers would leave some behind
+    std::vector<bool> listed(ok ? static_cast<size_t>(h.width)*h.height : 0, false);
+    for(uint64_t i=0;ok && i<h.num_null_cells;++i) {
+        int32_t x = nulls[2*i], y = nulls[2*i+1];
+        // a barrier off the grid would index outside the population
+        if(x < 0 || x >= h.width || y < 0 || y >= h.height) {
+            ok = false;
+            break;
+        }
+        size_t pos = static_cast<size_t>(y)*h.width + x;
+        if(listed[pos] || color[pos] != null_allele) {
+            ok = false;
+            break;
+        }
+        listed[pos] = true;
+        ck->null_cells.emplace_back(x, y);
+    }
+    ok = ok && h.num_null_cells == plane_nulls;
+    munmap(data, size);
+    return ok;
+}
+
+void apply_checkpoint_args(const checkpoint_t &ck, worker_arg_t *opt) {
+    opt->engine = ck.arg.engine;
+    opt->neighborhood = ck.arg.neighborhood;
+    opt->boundary = ck.arg.boundary;
+    opt->dispersal = ck.arg.dispersal;
+    opt->dispersal_radius = ck.arg.dispersal_radius;
+    opt->jump_rate = ck.arg.jump_rate;
+    opt->seed = ck.arg.seed;
+}
@@ -0,0 +1,33 @@
+#ifndef CARTWRIGHT_CHECKPOINT_H
+#define CARTWRIGHT_CHECKPOINT_H
+
+#include <string>
+
+#include "worker.h"
+
+// Everything needed to continue a run where it stopped. Only the model
+// parameters of arg are saved; threads, kernel, and rate belong to the
+// machine that runs it.
+struct checkpoint_t {
+    int width{0};
+    int height{0};
+    double mu{0.0};
+    worker_arg_t arg;
+    unsigned long long generation{0};
+    std::pair<uint64_t,uint64_t> rand_state;
+    pop_t pop;
+    barriers_t null_cells;
+};
+
+// Write ck to name. The file is written next to name and renamed over it,
+// so a crash while saving leaves the previous checkpoint intact.
+bool save_checkpoint(const std::string &name, const checkpoint_t &ck);
+
+// Map name into memory and read it into ck. Returns false if the file
+// cannot be opened or is not a checkpoint of this version.
+bool load_checkpoint(const std::string &name, checkpoint_t *ck);
+
+// Copy the model parameters of ck into opt.
+void apply_checkpoint_args(const checkpoint_t &ck, worker_arg_t *opt);
+
+#endif
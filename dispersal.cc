@@ -0,0 +1,199 @@
+#include "dispersal.h"
+#include "philox.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+// The tails beyond the range hold less than 1e-3 of the mass. It is
+// computed in double, as a huge radius would overflow an int.
+double kernel_range(dispersal_t shape, double radius) {
+    return std::ceil(radius*(shape == dispersal_t::gaussian ? 4.0 : 9.0));
+}
+
+}
+
+// A torus repeats every n cells and a reflecting edge every 2n, so
+// farther offsets fold onto nearer ones. On an absorbing grid an offset of
+// n or more cells falls off from every cell; those share the entry hi+1.
+dispersal_kernel::axis_t::axis_t(int range, int n, boundary_t boundary) {
+    period = (boundary == boundary_t::torus) ? n :
+             (boundary == boundary_t::reflect) ? 2*n : 0;
+    if(period == 0) {
+        hi = std::min(range, n-1);
+        lo = -hi;
+    } else if(2*range+1 <= period) {
+        lo = -range;
+        hi = range;
+    } else {
+        lo = -((period-1)/2);
+        hi = lo+period-1;
+    }
+}
+
+int dispersal_kernel::axis_t::fold(int d) const {
+    if(period == 0) {
+        return (d < lo || d > hi) ? hi+1 : d;
+    }
+    return ((d-lo) % period + period) % period + lo;
+}
+
+bool dispersal_kernel::fits(dispersal_t shape, double radius, boundary_t boundary,
+    int width, int height)
+{
+    double range = kernel_range(shape, radius);
+    if(range > max_range) {
+        return false;
+    }
+    axis_t ax(static_cast<int>(range), width, boundary);
+    axis_t ay(static_cast<int>(range), height, boundary);
+    // absorbing axes have one more entry for the offsets that fall off
+    double size = static_cast<double>(ax.hi-ax.lo+2)*(ay.hi-ay.lo+2);
+    return size <= max_table_size;
+}
+
+dispersal_kernel::dispersal_kernel(dispersal_t shape, double radius, double jump,
+    int candidates, boundary_t boundary, int width, int height) :
+    jump_{jump}, candidates_{candidates}, boundary_{boundary}
+{
+    assert(radius > 0.0);
+    assert(0 < candidates && candidates <= max_candidates);
+    assert(fits(shape, radius, boundary, width, height));
+    int range = static_cast<int>(kernel_range(shape, radius));
+    axis_t ax(range, width, boundary);
+    axis_t ay(range, height, boundary);
+    // sum the kernel over every offset within range into the folded table
+    int nx = ax.hi-ax.lo+2, ny = ay.hi-ay.lo+2;
+    std::vector<double> folded(static_cast<size_t>(nx)*ny, 0.0);
+    for(int dy=-range;dy<=range;++dy) {
+        int fy = ay.fold(dy)-ay.lo;
+        for(int dx=-range;dx<=range;++dx) {
+            if(dx == 0 && dy == 0) {
+                // the cell itself is always a candidate
+                continue;
+            }
+            // relative to the nearest neighbors, so a tiny radius does not
+            // underflow every weight
+            double d2 = static_cast<double>(dx)*dx+static_cast<double>(dy)*dy;
+            double w = (shape == dispersal_t::gaussian) ? std::exp(-(d2-1.0)/(2.0*radius*radius))
+                                                         : std::exp(-(std::sqrt(d2)-1.0)/radius);
+            folded[static_cast<size_t>(fy)*nx + ax.fold(dx)-ax.lo] += w;
+        }
+    }
+    // the extra entry of an absorbing axis is an offset that always falls off
+    std::vector<double> weight;
+    for(int fy=0;fy<ny;++fy) {
+        for(int fx=0;fx<nx;++fx) {
+            double w = folded[static_cast<size_t>(fy)*nx + fx];
+            if(w > 0.0) {
+                dx_.push_back((fx == nx-1 && ax.period == 0) ? width : fx+ax.lo);
+                dy_.push_back((fy == ny-1 && ay.period == 0) ? height : fy+ay.lo);
+                weight.push_back(w);
+            }
+        }
+    }
+    table_ = alias_table(weight);
+}
+
+bool dispersal_kernel::wrap(int *v, int n) const {
+    switch(boundary_) {
+    case boundary_t::torus:
+        *v = ((*v % n)+n) % n;
+        return true;
+    case boundary_t::reflect:
+        // mirror images repeat every 2n cells
+        *v = ((*v % (2*n))+2*n) % (2*n);
+        if(*v >= n) {
+            *v = 2*n-1-*v;
+        }
+        return true;
+    default:
+        return false;
+    }
+}
+
+template<typename RNG>
+int dispersal_kernel::sample(const pop_t &pop, int x, int y, RNG &rand) const {
+    uint64_t u = rand.get_uint64();
+    if(jump_ > 0.0 && rand.get_double52() < jump_) {
+        int x2 = static_cast<int>(((u >> 32)*pop.width) >> 32);
+        int y2 = static_cast<int>(((u & UINT64_C(0xFFFFFFFF))*pop.height) >> 32);
+        return pop.index(x2,y2);
+    }
+    size_t k = table_.sample(u);
+    int x2 = x+dx_[k];
+    int y2 = y+dy_[k];
+    if(x2 < 0 || x2 >= pop.width) {
+        if(!wrap(&x2, pop.width)) {
+            return -1;
+        }
+    }
+    if(y2 < 0 || y2 >= pop.height) {
+        if(!wrap(&y2, pop.height)) {
+            return -1;
+        }
+    }
+    return pop.index(x2,y2);
+}
+
+template<typename RNG>
+void dispersal_kernel::update_cell(const pop_t &a, pop_t &b, int x, int y, RNG &rand,
+    color_count_t &color_count) const
+{
+    const int pos = a.index(x,y);
+    int candidate[max_candidates+1];
+    double cumulative[max_candidates+1];
+    int n = 0;
+    double total = 0.0;
+    auto add = [&](int pos2) {
+        if(pos2 >= 0 && a.is_fertile(pos2)) {
+            total += a.fitness[pos2];
+            cumulative[n] = total;
+            candidate[n++] = pos2;
+        }
+    };
+    add(pos);
+    for(int k=0;k<candidates_;++k) {
+        add(sample(a, x, y, rand));
+    }
+
+    int src = pos;
+    if(n > 0) {
+        double u = rand.get_double52()*total;
+        int i = 0;
+        while(i < n-1 && cumulative[i] <= u) {
+            ++i;
+        }
+        src = candidate[i];
+    }
+    b.color[pos] = a.color[src];
+    b.fitness[pos] = a.fitness[src];
+    color_count[a.color[src]] += 1;
+}
+
+void dispersal_kernel::update_rows(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, color_count_t &color_count) const
+{
+    for(int y=y0;y<y1;++y) {
+        for(const span_t &span : spans[y]) {
+            for(int x=span.x0;x<span.x1;++x) {
+                update_cell(a, b, x, y, rand, color_count);
+            }
+        }
+    }
+}
+
+void dispersal_kernel::update_rows(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count) const
+{
+    for(int y=y0;y<y1;++y) {
+        for(const span_t &span : spans[y]) {
+            for(int x=span.x0;x<span.x1;++x) {
+                philox_stream rand(seed, x+static_cast<uint64_t>(y)*a.width, generation);
+                update_cell(a, b, x, y, rand, color_count);
+            }
+        }
+    }
+}
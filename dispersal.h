@@ -0,0 +1,73 @@
+#ifndef CARTWRIGHT_DISPERSAL_H
+#define CARTWRIGHT_DISPERSAL_H
+
+#include "worker.h"
+#include "alias_table.h"
+
+// Long-range dispersal. Instead of its fixed neighbors, every cell competes
+// against parents whose offsets are drawn from a dispersal kernel. The
+// kernel is tabulated over all offsets within its range, and an alias table
+// samples one of them in O(1).
+class dispersal_kernel {
+public:
+    // candidates is the number of parents drawn for each cell besides the
+    // cell itself. radius is the standard deviation of the gaussian kernel
+    // or the mean distance of the exponential one. With probability jump a
+    // parent comes from anywhere on the grid instead.
+    dispersal_kernel(dispersal_t shape, double radius, double jump,
+        int candidates, boundary_t boundary, int width, int height);
+
+    // Whether the table of a kernel fits on a width x height grid within
+    // max_range and max_table_size.
+    static bool fits(dispersal_t shape, double radius, boundary_t boundary,
+        int width, int height);
+
+    int candidates() const {
+        return candidates_;
+    }
+
+    // Update the non-null cells of rows [y0,y1). Parents that fall off the
+    // grid or on a barrier are rejected, and the winner is drawn among the
+    // remaining fertile ones in proportion to fitness.
+    void update_rows(const pop_t &a, pop_t &b, const row_spans_t *spans,
+        int y0, int y1, xorshift64 &rand, color_count_t &color_count) const;
+    // Same, with a counter-based stream for every cell as in update_rows_seeded.
+    void update_rows(const pop_t &a, pop_t &b, const row_spans_t *spans,
+        int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count) const;
+
+    static constexpr int max_candidates = 8;
+    // Limits on the offsets summed into the table and on its entries.
+    static constexpr int max_range = 4096;
+    static constexpr size_t max_table_size = size_t(1) << 22;
+
+private:
+    // Index of a parent for cell {x,y} of pop, or -1 if the draw falls off
+    // an absorbing edge.
+    template<typename RNG>
+    int sample(const pop_t &pop, int x, int y, RNG &rand) const;
+
+    // Update one cell with draws from rand.
+    template<typename RNG>
+    void update_cell(const pop_t &a, pop_t &b, int x, int y, RNG &rand,
+        color_count_t &color_count) const;
+
+    // Map a coordinate beyond [0,n) back onto the grid.
+    bool wrap(int *v, int n) const;
+
+    // Offsets along one axis of n cells that the table tells apart.
+    struct axis_t {
+        axis_t(int range, int n, boundary_t boundary);
+        // The offset in [lo,hi] that d lands like, or hi+1 if d falls off
+        // from every cell.
+        int fold(int d) const;
+        int lo, hi, period;
+    };
+
+    alias_table table_;
+    std::vector<int> dx_, dy_;
+    double jump_;
+    int candidates_;
+    boundary_t boundary_;
+};
+
+#endif
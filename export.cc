@@ -0,0 +1,305 @@
+#include "export.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+
+// logo.inl is a GdkPixdata dump; only its bytes are needed here
+typedef uint8_t guint8;
+#include "logo.inl"
+
+#define OVERLAY_ALPHA 0.85
+
+namespace {
+
+// 5x7 digits and a comma for the generation count, one row per byte
+const uint8_t glyphs[11][7] = {
+    {0x0E,0x11,0x13,0x15,0x19,0x11,0x0E}, {0x04,0x0C,0x04,0x04,0x04,0x04,0x0E},
+    {0x0E,0x11,0x01,0x02,0x04,0x08,0x1F}, {0x1F,0x02,0x04,0x02,0x01,0x11,0x0E},
+    {0x02,0x06,0x0A,0x12,0x1F,0x02,0x02}, {0x1F,0x10,0x1E,0x01,0x01,0x11,0x0E},
+    {0x06,0x08,0x10,0x1E,0x11,0x11,0x0E}, {0x1F,0x01,0x02,0x04,0x08,0x08,0x08},
+    {0x0E,0x11,0x11,0x0E,0x11,0x11,0x0E}, {0x0E,0x11,0x11,0x0F,0x01,0x02,0x0C},
+    {0x00,0x00,0x00,0x00,0x00,0x04,0x08}
+};
+
+uint32_t get_be32(const uint8_t *p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+void put_be32(std::vector<uint8_t> *out, uint32_t v) {
+    uint8_t b[4] = {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)};
+    out->insert(out->end(), b, b+4);
+}
+
+// blend a white pixel with opacity alpha into rgb
+void blend_white(uint8_t *rgb, double alpha) {
+    for(int c=0;c<3;++c) {
+        rgb[c] = static_cast<uint8_t>(rgb[c] + (255-rgb[c])*alpha + 0.5);
+    }
+}
+
+} // namespace
+
+frame_exporter::frame_exporter(const std::string &name, int width, int height, int scale,
+    bool hex, bool overlay, int fps, size_t max_queue) :
+    name_{name}, width_{width}, height_{height}, scale_{scale},
+    hex_{hex}, overlay_{overlay}, max_queue_{std::max<size_t>(max_queue,1)}
+{
+    raster_width_ = width*scale + (hex ? scale/2 : 0);
+    raster_height_ = height*scale;
+    y4m_ = name.size() >= 4 && name.compare(name.size()-4, 4, ".y4m") == 0;
+    if(y4m_) {
+        video_ = std::fopen(name.c_str(), "wb");
+        if(video_ == nullptr) {
+            return;
+        }
+        // full chroma, since cells are sharp-edged blocks
+        std::fprintf(video_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n",
+            raster_width_, raster_height_, fps);
+    } else if(!parse_pattern(name)) {
+        return;
+    }
+    open_ = true;
+    thread_ = std::thread([this]{ encode_thread(); });
+}
+
+frame_exporter::~frame_exporter() {
+    if(!open_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_ = true;
+        ready_.notify_one();
+    }
+    thread_.join();
+    if(video_ != nullptr && std::fclose(video_) != 0) {
+        failed_ = true;
+    }
+    if(failed_) {
+        std::cerr << "Unable to write the exported frames." << std::endl;
+    }
+}
+
+void frame_exporter::push(colors_t colors, unsigned long long generation) {
+    if(!open_) {
+        return;
+    }
+    std::unique_lock<std::mutex> lock{mutex_};
+    while(queue_.size() >= max_queue_) {
+        room_.wait(lock);
+    }
+    queue_.emplace_back(std::move(colors), generation);
+    ready_.notify_one();
+}
+
+void frame_exporter::encode_thread() {
+    for(;;) {
+        std::pair<colors_t,unsigned long long> item;
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            while(queue_.empty() && !stop_) {
+                ready_.wait(lock);
+            }
+            if(queue_.empty()) {
+                return;
+            }
+            item = std::move(queue_.front());
+            queue_.pop_front();
+            room_.notify_one();
+        }
+        if(failed_) {
+            continue;
+        }
+        render(item.first, item.second);
+        if(y4m_) {
+            failed_ = !write_y4m();
+        } else {
+            failed_ = !write_png(frame_name(frames_));
+        }
+        frames_ += 1;
+    }
+}
+
+bool frame_exporter::parse_pattern(const std::string &name) {
+    // the pattern is never handed to printf, so only these forms are taken
+    bool found = false;
+    std::string *part = &prefix_;
+    for(size_t i=0;i<name.size();++i) {
+        if(name[i] != '%') {
+            *part += name[i];
+            continue;
+        }
+        if(++i < name.size() && name[i] == '%') {
+            *part += '%';
+            continue;
+        }
+        if(found) {
+            return false;
+        }
+        size_t start = i;
+        while(i < name.size() && std::isdigit(static_cast<unsigned char>(name[i]))) {
+            ++i;
+        }
+        if(i == name.size() || name[i] != 'd' || i-start > 2) {
+            return false;
+        }
+        zero_pad_ = (i > start && name[start] == '0');
+        digits_ = (i > start) ? std::stoi(name.substr(start, i-start)) : 0;
+        found = true;
+        part = &suffix_;
+    }
+    return found;
+}
+
+std::string frame_exporter::frame_name(unsigned long long frame) const {
+    std::string number = std::to_string(frame);
+    if(static_cast<int>(number.size()) < digits_) {
+        number.insert(0, digits_-number.size(), zero_pad_ ? '0' : ' ');
+    }
+    return prefix_ + number + suffix_;
+}
+
+void frame_exporter::render(const colors_t &colors, unsigned long long generation) {
+    // channels in the order Sim1942::on_draw passes them to Cairo
+    uint8_t palette[num_colors][3];
+    for(size_t a=0;a<num_colors;++a) {
+        palette[a][0] = static_cast<uint8_t>(col_set[a].red*255.0+0.5);
+        palette[a][1] = static_cast<uint8_t>(col_set[a].blue*255.0+0.5);
+        palette[a][2] = static_cast<uint8_t>(col_set[a].green*255.0+0.5);
+    }
+    rgb_.assign(3*raster_width_*raster_height_, 0);
+    for(int y=0;y<height_;++y) {
+        // draw the first pixel row of the cells, then copy it down
+        uint8_t *row = &rgb_[3*(y*scale_)*raster_width_];
+        uint8_t *p = row + 3*((hex_ && (y & 1)) ? scale_/2 : 0);
+        for(int x=0;x<width_;++x) {
+            const uint8_t *c = palette[colors[x+y*width_]];
+            for(int i=0;i<scale_;++i, p+=3) {
+                p[0] = c[0]; p[1] = c[1]; p[2] = c[2];
+            }
+        }
+        for(int i=1;i<scale_;++i) {
+            std::memcpy(row + 3*i*raster_width_, row, 3*raster_width_);
+        }
+    }
+    if(overlay_) {
+        draw_overlay(generation);
+    }
+}
+
+void frame_exporter::draw_overlay(unsigned long long generation) {
+    // the logo in the lower left corner
+    const uint8_t *logo = logo_inline;
+    uint32_t rowstride = get_be32(logo+12);
+    int logo_width = get_be32(logo+16);
+    int logo_height = get_be32(logo+20);
+    const uint8_t *pixels = logo+24;
+    int x0 = static_cast<int>(0.025*raster_width_);
+    int y0 = raster_height_ - logo_height - static_cast<int>(0.025*raster_height_);
+    if(y0 >= 0 && x0+logo_width <= raster_width_) {
+        for(int y=0;y<logo_height;++y) {
+            const uint8_t *src = pixels + y*rowstride;
+            uint8_t *dst = &rgb_[3*((y0+y)*raster_width_ + x0)];
+            for(int x=0;x<logo_width;++x, src+=4, dst+=3) {
+                double alpha = OVERLAY_ALPHA*src[3]/255.0;
+                for(int c=0;c<3;++c) {
+                    dst[c] = static_cast<uint8_t>(dst[c]*(1.0-alpha) + src[c]*alpha + 0.5);
+                }
+            }
+        }
+    }
+
+    // the generation in the lower right corner, with thousands separators
+    std::string digits = std::to_string(generation);
+    std::vector<int> text;
+    for(size_t i=0;i<digits.size();++i) {
+        if(i > 0 && (digits.size()-i) % 3 == 0) {
+            text.push_back(10);
+        }
+        text.push_back(digits[i]-'0');
+    }
+    int px = std::max(1, raster_height_/180);
+    int text_width = (6*static_cast<int>(text.size())-1)*px;
+    int tx = raster_width_ - text_width - static_cast<int>(0.025*raster_width_);
+    int ty = raster_height_ - 7*px - static_cast<int>(0.025*raster_height_);
+    if(tx < 0 || ty < 0) {
+        return;
+    }
+    for(size_t k=0;k<text.size();++k) {
+        for(int gy=0;gy<7;++gy) {
+            for(int gx=0;gx<5;++gx) {
+                if(!(glyphs[text[k]][gy] & (0x10 >> gx))) {
+                    continue;
+                }
+                for(int i=0;i<px;++i) {
+                    for(int j=0;j<px;++j) {
+                        int x = tx + (6*static_cast<int>(k)+gx)*px + j;
+                        int y = ty + gy*px + i;
+                        blend_white(&rgb_[3*(y*raster_width_+x)], OVERLAY_ALPHA);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// An RGB PNG. Every row uses the Up filter, so the rows repeated by the
+// scale compress to almost nothing.
+bool frame_exporter::write_png(const std::string &name) {
+    const size_t stride = 3*raster_width_;
+    buffer_.resize((stride+1)*raster_height_);
+    for(int y=0;y<raster_height_;++y) {
+        uint8_t *out = &buffer_[y*(stride+1)];
+        const uint8_t *row = &rgb_[y*stride];
+        out[0] = 2;
+        for(size_t i=0;i<stride;++i) {
+            out[1+i] = row[i] - (y > 0 ? row[i-stride] : 0);
+        }
+    }
+    uLongf size = compressBound(buffer_.size());
+    compressed_.resize(size);
+    if(compress2(compressed_.data(), &size, buffer_.data(), buffer_.size(), Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+
+    std::vector<uint8_t> png = {0x89,'P','N','G','\r','\n',0x1A,'\n'};
+    auto chunk = [&png](const char *type, const uint8_t *data, size_t n) {
+        put_be32(&png, n);
+        size_t start = png.size();
+        png.insert(png.end(), type, type+4);
+        png.insert(png.end(), data, data+n);
+        put_be32(&png, crc32(0, &png[start], n+4));
+    };
+    std::vector<uint8_t> header;
+    put_be32(&header, raster_width_);
+    put_be32(&header, raster_height_);
+    header.insert(header.end(), {8, 2, 0, 0, 0});
+    chunk("IHDR", header.data(), header.size());
+    chunk("IDAT", compressed_.data(), size);
+    chunk("IEND", nullptr, 0);
+
+    FILE *out = std::fopen(name.c_str(), "wb");
+    if(out == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(png.data(), 1, png.size(), out) == png.size();
+    return (std::fclose(out) == 0) && ok;
+}
+
+// One YUV4MPEG2 frame in BT.601 studio range.
+bool frame_exporter::write_y4m() {
+    const size_t n = raster_width_*raster_height_;
+    buffer_.resize(3*n);
+    for(size_t i=0;i<n;++i) {
+        int r = rgb_[3*i], g = rgb_[3*i+1], b = rgb_[3*i+2];
+        buffer_[i] = static_cast<uint8_t>(((66*r + 129*g + 25*b + 128) >> 8) + 16);
+        buffer_[n+i] = static_cast<uint8_t>(((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+        buffer_[2*n+i] = static_cast<uint8_t>(((112*r - 94*g - 18*b + 128) >> 8) + 128);
+    }
+    return std::fputs("FRAME\n", video_) >= 0
+        && std::fwrite(buffer_.data(), 1, buffer_.size(), video_) == buffer_.size();
+}
@@ -0,0 +1,75 @@
+#ifndef CARTWRIGHT_EXPORT_H
+#define CARTWRIGHT_EXPORT_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "worker.h"
+
+// Renders generations into images without a display and writes them on a
+// background thread, so the simulation keeps running while frames are
+// encoded. Every cell becomes a scale x scale block in the colors of
+// col_set. A name ending in .y4m is written as one YUV4MPEG2 video; any
+// other name is a pattern for a sequence of PNG images with exactly one
+// %d, %5d, or %05d for the frame number, such as frame%05d.png. %% stands
+// for a percent sign; any other use of % is an error.
+class frame_exporter {
+public:
+    // With overlay, the logo and the generation are drawn over the grid as
+    // Sim1942::on_draw places them. hex shifts odd rows by half a cell.
+    frame_exporter(const std::string &name, int width, int height, int scale,
+        bool hex, bool overlay, int fps, size_t max_queue = 8);
+    // Write the frames still queued.
+    ~frame_exporter();
+
+    bool is_open() const {
+        return open_;
+    }
+
+    // Queue a frame. Blocks while max_queue frames are waiting, because an
+    // export must not drop frames.
+    void push(colors_t colors, unsigned long long generation);
+
+private:
+    void encode_thread();
+    void render(const colors_t &colors, unsigned long long generation);
+    void draw_overlay(unsigned long long generation);
+    bool write_png(const std::string &name);
+    bool write_y4m();
+
+    // Split a PNG pattern around its frame number.
+    bool parse_pattern(const std::string &name);
+    std::string frame_name(unsigned long long frame) const;
+
+    std::string name_;
+    // the parts of a PNG pattern and the width of its frame number
+    std::string prefix_, suffix_;
+    int digits_{0};
+    bool zero_pad_{false};
+    int width_, height_, scale_;
+    bool hex_, overlay_;
+    bool y4m_;
+    bool open_{false};
+    FILE *video_{nullptr};
+    unsigned long long frames_{0};
+    size_t max_queue_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_, room_;
+    std::deque<std::pair<colors_t,unsigned long long>> queue_;
+    bool stop_{false};
+    std::thread thread_;
+
+    // owned by the encode thread
+    int raster_width_, raster_height_;
+    std::vector<uint8_t> rgb_;
+    std::vector<uint8_t> buffer_, compressed_;
+    bool failed_{false};
+};
+
+#endif
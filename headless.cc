@@ -0,0 +1,171 @@
+// Runs the simulation without a display, for batch jobs on servers.
+// Nothing here touches GTK, so no fonts, pixbufs, or D-Bus are loaded.
+
+#include "worker.h"
+#include "mapfile.h"
+#include "export.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+namespace boost { namespace program_options {
+
+template<>
+typed_value<bool> *value(bool *v) {
+    return bool_switch(v);
+}
+
+}}
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <exception>
+
+// use X-Macros to specify argument variables
+struct arg_t {
+#define XM(lname, sname, desc, type, def) type XV(lname) ;
+# include "headless.xmh"
+#undef XM
+    std::string run_name;
+    std::string run_path;
+};
+
+arg_t process_command_line(po::options_description *opt_desc, int argc, char** argv);
+
+bool write_ppm(const std::string &name, const colors_t &colors, int width, int height);
+
+int main(int argc, char** argv) {
+    po::options_description desc{"Allowed Options"};
+    arg_t arg;
+    try {
+        arg = process_command_line(&desc, argc, argv);
+    } catch(std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if(arg.help) {
+        std::cerr << "Usage:\n  " << arg.run_name << " [ options ]\n";
+        std::cerr << desc << "\n";
+        return 0;
+    }
+
+    worker_options_t options;
+#define XM(lname, sname, desc, type, def) options.XV(lname) = arg.XV(lname);
+#   include "worker.xmh"
+#undef XM
+    worker_arg_t worker_arg;
+    if(!make_worker_arg(&options, &worker_arg)) {
+        return 1;
+    }
+    // a resumed run replaces the size and mutation rate
+    arg.width = options.width;
+    arg.height = options.height;
+    arg.mu = options.mu;
+    if(arg.export_every <= 0 || arg.export_scale <= 0 || arg.export_fps <= 0) {
+        std::cerr << "Invalid export options." << std::endl;
+        return 1;
+    }
+
+    barriers_t barriers;
+    // a resumed run already holds its barriers
+    if(!arg.map_file.empty() && !worker_arg.resume) {
+        std::cout << "Reading map from file \"" << arg.map_file << "\".\n";
+        barriers = process_map_file(arg.map_file);
+        if(barriers.empty()) {
+            std::cerr << "Unable to process map file." << std::endl;
+            return 2;
+        }
+    }
+
+    Worker worker(arg.width,arg.height,arg.mu,0,worker_arg);
+    if(!barriers.empty()) {
+        worker.toggle_cells(barriers, true);
+    }
+
+    std::unique_ptr<frame_exporter> exporter;
+    if(!arg.export_file.empty()) {
+        exporter.reset(new frame_exporter(arg.export_file, arg.width, arg.height, arg.export_scale,
+            worker_arg.neighborhood == neighborhood_t::hex, arg.overlay, arg.export_fps));
+        if(!exporter->is_open()) {
+            std::cerr << "Unable to write frames to \"" << arg.export_file
+                      << "\"; name a .y4m video or PNG images with one %d, as in frame%05d.png." << std::endl;
+            return 2;
+        }
+    }
+
+    double start = worker.elapsed();
+    worker.run(arg.generations, [&]{
+        if(!exporter) {
+            return;
+        }
+        const snapshot_t &frame = worker.latest();
+        if(frame.generation % arg.export_every == 0) {
+            exporter->push(frame.colors, frame.generation);
+        }
+    });
+    exporter.reset();
+    double secs = worker.elapsed() - start;
+
+    char buf[256];
+    std::snprintf(buf, 256, "%'llu generations in %0.2fs: %0.1f generations/s, %0.3g cells/s.\n",
+        arg.generations, secs, arg.generations/secs,
+        static_cast<double>(arg.generations)*arg.width*arg.height/secs);
+    std::cout << buf;
+
+    if(!arg.output.empty()) {
+        if(!write_ppm(arg.output, worker.latest().colors, arg.width, arg.height)) {
+            std::cerr << "Unable to write \"" << arg.output << "\"." << std::endl;
+            return 2;
+        }
+        std::cout << "Final state written to \"" << arg.output << "\".\n";
+    }
+
+    return 0;
+}
+
+arg_t process_command_line(po::options_description *opt_desc, int argc, char** argv) {
+    po::variables_map vm;
+    arg_t arg;
+    boost::filesystem::path bin_path(argv[0]);
+    arg.run_name = bin_path.filename().generic_string();
+    arg.run_path = bin_path.parent_path().generic_string();
+
+    opt_desc->add_options()
+    #define XM(lname, sname, desc, type, def) ( \
+        XS(lname) IFD(sname, "," BOOST_PP_STRINGIZE sname), \
+        po::value< type >(&arg.XV(lname))->default_value(def), \
+        desc )
+    #   include "headless.xmh"
+    #undef XM
+        ;
+
+    po::store(po::command_line_parser(argc, argv).options(*opt_desc).run(), vm);
+    po::notify(vm);
+
+    return arg;
+}
+
+// Write one pixel per cell. Channels are ordered as Sim1942::on_draw passes
+// them to Cairo, so the image matches what the display shows.
+bool write_ppm(const std::string &name, const colors_t &colors, int width, int height) {
+    std::ofstream out(name, std::ios::binary);
+    if(!out) {
+        return false;
+    }
+    out << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<char> row(3*width);
+    for(int y=0;y<height;++y) {
+        for(int x=0;x<width;++x) {
+            const color_rgb &c = col_set[colors[x+y*width]];
+            row[3*x+0] = static_cast<char>(c.red*255.0+0.5);
+            row[3*x+1] = static_cast<char>(c.blue*255.0+0.5);
+            row[3*x+2] = static_cast<char>(c.green*255.0+0.5);
+        }
+        out.write(row.data(), row.size());
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,224 @@
+#ifndef CARTWRIGHT_KERNEL_H
+#define CARTWRIGHT_KERNEL_H
+
+#include "worker.h"
+#include "rexp.h"
+#include "philox.h"
+
+/************************************************************
+ * Neighborhoods                                            *
+ ************************************************************/
+
+// A neighborhood lists the index offsets of the neighbors of a cell in row
+// y of a padded population. size is a compile-time constant, so the loops
+// over neighbors in the kernels are unrolled.
+
+// left, up, right, down
+struct von_neumann {
+    static constexpr int size = 4;
+    static void offsets(int stride, int, int *out) {
+        out[0] = -1; out[1] = -stride; out[2] = 1; out[3] = stride;
+    }
+};
+
+// the von Neumann neighbors and the four diagonals
+struct moore {
+    static constexpr int size = 8;
+    static void offsets(int stride, int, int *out) {
+        out[0] = -1; out[1] = -stride; out[2] = 1; out[3] = stride;
+        out[4] = -stride-1; out[5] = -stride+1; out[6] = stride+1; out[7] = stride-1;
+    }
+};
+
+// A hexagonal lattice stored in offset rows: odd rows sit half a cell to
+// the right of even rows.
+struct hex {
+    static constexpr int size = 6;
+    static void offsets(int stride, int y, int *out) {
+        int odd = y & 1;
+        out[0] = -1; out[1] = 1;
+        out[2] = -stride-1+odd; out[3] = -stride+odd;
+        out[4] = stride-1+odd; out[5] = stride+odd;
+    }
+};
+
+/************************************************************
+ * Scalar generation kernel                                 *
+ ************************************************************/
+
+// Update the cell at {x,y} of b by letting it and its neighbors in a race
+// to colonize it. Each call of exps() returns a unit exponential waiting
+// time. The border of a is null or a copy of the edge,
+// so no neighbor needs a bounds check. Null cells are never written; b
+// must already hold them.
+template<typename N, typename Exp>
+inline void update_cell(const pop_t &a, pop_t &b, int x, int y,
+    Exp &exps, color_count_t &color_count)
+{
+    const int pos = a.index(x,y);
+    int offsets[N::size];
+    N::offsets(a.stride, y, offsets);
+
+    double weight = a.is_fertile(pos) ? exps()/a.fitness[pos] : INFINITY;
+    int src = pos;
+    for(int k=0;k<N::size;++k) {
+        int pos2 = pos+offsets[k];
+        double w;
+        if(a.is_fertile(pos2) && (w = exps()/a.fitness[pos2]) < weight) {
+            weight = w;
+            src = pos2;
+        }
+    }
+    b.color[pos] = a.color[src];
+    b.fitness[pos] = a.fitness[src];
+    color_count[a.color[src]] += 1;
+}
+
+// Same as update_cell, but the colonizer is chosen with one uniform draw.
+// Each fertile candidate wins with probability proportional to its fitness,
+// which is the distribution of the winner of update_cell's race.
+template<typename N, typename RNG>
+inline void update_cell_draw(const pop_t &a, pop_t &b, int x, int y,
+    RNG &rand, color_count_t &color_count)
+{
+    const int pos = a.index(x,y);
+    int candidates[N::size+1];
+    N::offsets(a.stride, y, candidates+1);
+    candidates[0] = pos;
+    for(int k=1;k<=N::size;++k) {
+        candidates[k] += pos;
+    }
+
+    double cumulative[N::size+1];
+    double total = 0.0;
+    for(int k=0;k<=N::size;++k) {
+        int pos2 = candidates[k];
+        total += a.is_fertile(pos2) ? a.fitness[pos2] : 0.0;
+        cumulative[k] = total;
+    }
+
+    int src = pos;
+    if(total > 0.0) {
+        double u = rand.get_double52()*total;
+        int k = 0;
+        while(k < N::size && cumulative[k] <= u) {
+            ++k;
+        }
+        // u can round up to total; fall back to the last fertile candidate
+        while(!a.is_fertile(candidates[k])) {
+            --k;
+        }
+        src = candidates[k];
+    }
+    b.color[pos] = a.color[src];
+    b.fitness[pos] = a.fitness[src];
+    color_count[a.color[src]] += 1;
+}
+
+// Update the non-null cells of rows [y0,y1); spans[y] lists those of row y.
+template<typename N>
+inline void update_rows_scalar(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, color_count_t &color_count, engine_t engine)
+{
+    rand_exp_buffer exps(rand);
+    for(int y=y0;y<y1;++y) {
+        for(const span_t &span : spans[y]) {
+            if(engine == engine_t::draw) {
+                for(int x=span.x0;x<span.x1;++x) {
+                    update_cell_draw<N>(a, b, x, y, rand, color_count);
+                }
+            } else {
+                for(int x=span.x0;x<span.x1;++x) {
+                    update_cell<N>(a, b, x, y, exps, color_count);
+                }
+            }
+        }
+    }
+}
+
+inline void update_rows_scalar(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, color_count_t &color_count, engine_t engine,
+    neighborhood_t neighborhood)
+{
+    switch(neighborhood) {
+    case neighborhood_t::moore:
+        update_rows_scalar<moore>(a, b, spans, y0, y1, rand, color_count, engine);
+        break;
+    case neighborhood_t::hex:
+        update_rows_scalar<hex>(a, b, spans, y0, y1, rand, color_count, engine);
+        break;
+    default:
+        update_rows_scalar<von_neumann>(a, b, spans, y0, y1, rand, color_count, engine);
+        break;
+    }
+}
+
+// Update the cell at {x,y} of b with draws from its own stream, keyed by
+// the seed, the generation and the cell's position on the grid.
+template<typename N>
+inline void update_cell_seeded(const pop_t &a, pop_t &b, int x, int y,
+    uint64_t seed, uint64_t generation, color_count_t &color_count, engine_t engine)
+{
+    philox_stream rand(seed, x+static_cast<uint64_t>(y)*a.width, generation);
+    if(engine == engine_t::draw) {
+        update_cell_draw<N>(a, b, x, y, rand, color_count);
+    } else {
+        auto exps = [&rand]() { return rand_exp_zig(rand); };
+        update_cell<N>(a, b, x, y, exps, color_count);
+    }
+}
+
+// Same as update_rows_scalar, but every cell draws from its own stream.
+// The result does not depend on how the rows are split among threads.
+template<typename N>
+inline void update_rows_seeded(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine)
+{
+    for(int y=y0;y<y1;++y) {
+        for(const span_t &span : spans[y]) {
+            for(int x=span.x0;x<span.x1;++x) {
+                update_cell_seeded<N>(a, b, x, y, seed, generation, color_count, engine);
+            }
+        }
+    }
+}
+
+inline void update_rows_seeded(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine, neighborhood_t neighborhood)
+{
+    switch(neighborhood) {
+    case neighborhood_t::moore:
+        update_rows_seeded<moore>(a, b, spans, y0, y1, seed, generation, color_count, engine);
+        break;
+    case neighborhood_t::hex:
+        update_rows_seeded<hex>(a, b, spans, y0, y1, seed, generation, color_count, engine);
+        break;
+    default:
+        update_rows_seeded<von_neumann>(a, b, spans, y0, y1, seed, generation, color_count, engine);
+        break;
+    }
+}
+
+// Vectorized versions of update_rows_scalar that update 4 (AVX2) or 8
+// (AVX-512) neighboring cells at once. If the kernel was not compiled in,
+// these fall back to update_rows_scalar. Each lane draws from its own stream
+// of gen; rand finishes the rare ziggurat misses and the ends of rows.
+void update_rows_avx2(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, xorshift64x8 &gen,
+    color_count_t &color_count, engine_t engine, neighborhood_t neighborhood);
+void update_rows_avx512(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, xorshift64x8 &gen,
+    color_count_t &color_count, engine_t engine, neighborhood_t neighborhood);
+
+// Vectorized versions of update_rows_seeded. Each lane runs the stream of
+// its cell, so they produce exactly what update_rows_seeded does.
+void update_rows_seeded_avx2(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine, neighborhood_t neighborhood);
+void update_rows_seeded_avx512(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine, neighborhood_t neighborhood);
+
+#endif
@@ -0,0 +1,547 @@
+#include "kernel.h"
+
+#include <immintrin.h>
+#include <cstring>
+
+namespace {
+
+/************************************************************
+ * Vector traits                                            *
+ ************************************************************/
+
+#if defined(__AVX2__)
+struct avx2 {
+    static constexpr int width = 4;
+    typedef __m256i vi;
+    typedef __m256d vd;
+    typedef __m256i mask;
+
+    static vi load(const void *p) { return _mm256_loadu_si256(static_cast<const __m256i*>(p)); }
+    static vi loadc(const uint8_t *p) {
+        int32_t x;
+        std::memcpy(&x, p, sizeof(x));
+        return _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(x));
+    }
+    static void store(void *p, vi a) { _mm256_storeu_si256(static_cast<__m256i*>(p), a); }
+    static vd loadd(const double *p) { return _mm256_loadu_pd(p); }
+    static void stored(double *p, vd a) { _mm256_storeu_pd(p, a); }
+
+    static vi set1(uint64_t x) { return _mm256_set1_epi64x(static_cast<long long>(x)); }
+    static vi iota() { return _mm256_setr_epi64x(0,1,2,3); }
+    static vd set1d(double x) { return _mm256_set1_pd(x); }
+
+    static vi add(vi a, vi b) { return _mm256_add_epi64(a,b); }
+    // products of the low 32 bits
+    static vi mul32(vi a, vi b) { return _mm256_mul_epu32(a,b); }
+    static vi vand(vi a, vi b) { return _mm256_and_si256(a,b); }
+    static vi vor(vi a, vi b) { return _mm256_or_si256(a,b); }
+    static vi vxor(vi a, vi b) { return _mm256_xor_si256(a,b); }
+    template<int n> static vi slli(vi a) { return _mm256_slli_epi64(a,n); }
+    template<int n> static vi srli(vi a) { return _mm256_srli_epi64(a,n); }
+
+    static vd asd(vi a) { return _mm256_castsi256_pd(a); }
+    static vd add(vd a, vd b) { return _mm256_add_pd(a,b); }
+    static vd sub(vd a, vd b) { return _mm256_sub_pd(a,b); }
+    static vd mul(vd a, vd b) { return _mm256_mul_pd(a,b); }
+    static vd div(vd a, vd b) { return _mm256_div_pd(a,b); }
+    static vd fmadd(vd a, vd b, vd c) { return _mm256_add_pd(_mm256_mul_pd(a,b),c); }
+
+    static vi gather(const int64_t *p, vi i) { return _mm256_i64gather_epi64(reinterpret_cast<const long long*>(p), i, 8); }
+    static vd gather(const double *p, vi i) { return _mm256_i64gather_pd(p, i, 8); }
+
+    static mask gt(vi a, vi b) { return _mm256_cmpgt_epi64(a,b); }
+    static mask eq(vi a, vi b) { return _mm256_cmpeq_epi64(a,b); }
+    static mask lt(vd a, vd b) { return _mm256_castpd_si256(_mm256_cmp_pd(a,b,_CMP_LT_OQ)); }
+    static mask mand(mask a, mask b) { return _mm256_and_si256(a,b); }
+    static mask mnot(mask a) { return _mm256_xor_si256(a,_mm256_set1_epi64x(-1)); }
+    static int bits(mask m) { return _mm256_movemask_pd(_mm256_castsi256_pd(m)); }
+
+    // m ? b : a
+    static vi blend(mask m, vi a, vi b) { return _mm256_blendv_epi8(a,b,m); }
+    static vd blend(mask m, vd a, vd b) { return _mm256_blendv_pd(a,b,_mm256_castsi256_pd(m)); }
+};
+#endif
+
+#if defined(__AVX512F__)
+struct avx512 {
+    static constexpr int width = 8;
+    typedef __m512i vi;
+    typedef __m512d vd;
+    typedef __mmask8 mask;
+
+    static vi load(const void *p) { return _mm512_loadu_si512(p); }
+    static vi loadc(const uint8_t *p) { return _mm512_cvtepu8_epi64(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))); }
+    static void store(void *p, vi a) { _mm512_storeu_si512(p, a); }
+    static vd loadd(const double *p) { return _mm512_loadu_pd(p); }
+    static void stored(double *p, vd a) { _mm512_storeu_pd(p, a); }
+
+    static vi set1(uint64_t x) { return _mm512_set1_epi64(static_cast<long long>(x)); }
+    static vi iota() { return _mm512_setr_epi64(0,1,2,3,4,5,6,7); }
+    static vd set1d(double x) { return _mm512_set1_pd(x); }
+
+    static vi add(vi a, vi b) { return _mm512_add_epi64(a,b); }
+    // products of the low 32 bits
+    static vi mul32(vi a, vi b) { return _mm512_mul_epu32(a,b); }
+    static vi vand(vi a, vi b) { return _mm512_and_si512(a,b); }
+    static vi vor(vi a, vi b) { return _mm512_or_si512(a,b); }
+    static vi vxor(vi a, vi b) { return _mm512_xor_si512(a,b); }
+    template<int n> static vi slli(vi a) { return _mm512_slli_epi64(a,n); }
+    template<int n> static vi srli(vi a) { return _mm512_srli_epi64(a,n); }
+
+    static vd asd(vi a) { return _mm512_castsi512_pd(a); }
+    static vd add(vd a, vd b) { return _mm512_add_pd(a,b); }
+    static vd sub(vd a, vd b) { return _mm512_sub_pd(a,b); }
+    static vd mul(vd a, vd b) { return _mm512_mul_pd(a,b); }
+    static vd div(vd a, vd b) { return _mm512_div_pd(a,b); }
+    static vd fmadd(vd a, vd b, vd c) { return _mm512_fmadd_pd(a,b,c); }
+
+    static vi gather(const int64_t *p, vi i) { return _mm512_i64gather_epi64(i, p, 8); }
+    static vd gather(const double *p, vi i) { return _mm512_i64gather_pd(i, p, 8); }
+
+    static mask gt(vi a, vi b) { return _mm512_cmpgt_epi64_mask(a,b); }
+    static mask eq(vi a, vi b) { return _mm512_cmpeq_epi64_mask(a,b); }
+    static mask lt(vd a, vd b) { return _mm512_cmp_pd_mask(a,b,_CMP_LT_OQ); }
+    static mask mand(mask a, mask b) { return a & b; }
+    static mask mnot(mask a) { return static_cast<mask>(~a); }
+    static int bits(mask m) { return m; }
+
+    // m ? b : a
+    static vi blend(mask m, vi a, vi b) { return _mm512_mask_blend_epi64(m,a,b); }
+    static vd blend(mask m, vd a, vd b) { return _mm512_mask_blend_pd(m,a,b); }
+};
+#endif
+
+/************************************************************
+ * Vectorized generation kernel                             *
+ ************************************************************/
+
+// Convert integers less than 2^56 to double.
+template<typename V>
+inline typename V::vd to_double56(typename V::vi a) {
+    const typename V::vi magic = V::set1(UINT64_C(0x4330000000000000)); // 2^52
+    const typename V::vd two52 = V::set1d(4503599627370496.0);
+    typename V::vd hi = V::sub(V::asd(V::vor(V::template srli<32>(a), magic)), two52);
+    typename V::vd lo = V::sub(V::asd(V::vor(V::vand(a, V::set1(UINT64_C(0xFFFFFFFF))), magic)), two52);
+    return V::fmadd(hi, V::set1d(4294967296.0), lo);
+}
+
+// The lanes of a band's xorshift64x8, held in registers while a block of
+// rows is updated and written back afterwards. Every lane draws whether or
+// not it needs to. rand finishes the rare ziggurat misses and the cells at
+// the ends of rows.
+template<typename V>
+struct lane_rand {
+    typedef typename V::vi vi;
+    typedef typename V::vd vd;
+    typedef typename V::mask mask;
+
+    lane_rand(xorshift64x8 &gen, xorshift64 &rand) : gen_(gen), rand_(rand), exps_(rand),
+        u{V::load(gen.u)}, w{V::load(gen.w)} { }
+    ~lane_rand() {
+        V::store(gen_.u, u);
+        V::store(gen_.w, w);
+    }
+
+    // the streams run on from block to block
+    template<int D>
+    void start(int, int) { }
+
+    vi get_raw(mask) {
+        u = V::vxor(u, V::template slli<5>(u));
+        u = V::vxor(u, V::template srli<15>(u));
+        u = V::vxor(u, V::template slli<27>(u));
+        w = V::add(w, V::set1(UINT64_C(0x61C8864680B583EB)));
+        return V::add(u, V::vxor(w, V::template srli<27>(w)));
+    }
+
+    // Uniform (0,1) per lane, as in xorshift64::get_double52.
+    vd uniform() {
+        vi r = V::vor(V::template srli<12>(get_raw(mask())), V::set1(UINT64_C(0x3FF0000000000000)));
+        return V::sub(V::asd(r), V::set1d(1.0-(DBL_EPSILON/2.0)));
+    }
+
+    // Finish the ziggurat draws {a[i],b[i]} of the lanes set in bits.
+    void finish(int bits, const uint64_t *a, const uint64_t *b, double *x) {
+        for(int i=0;i<V::width;++i) {
+            if(bits & (1 << i)) {
+                x[i] = rand_exp_zig_slow(rand_, static_cast<int64_t>(a[i]), b[i]);
+            }
+        }
+    }
+
+    template<typename N, engine_t E>
+    void update_cell(const pop_t &a, pop_t &b, int x, int y, color_count_t &color_count) {
+        if(E == engine_t::draw) {
+            update_cell_draw<N>(a, b, x, y, rand_, color_count);
+        } else {
+            ::update_cell<N>(a, b, x, y, exps_, color_count);
+        }
+    }
+
+    xorshift64x8 &gen_;
+    xorshift64 &rand_;
+    rand_exp_buffer exps_;
+    vi u, w;
+};
+
+// The philox_stream of every cell of a block, one per lane, as
+// update_cell_seeded draws them. Only the lanes that need a draw take one,
+// so each lane keeps its own count of draws. start() computes the first D
+// draws of every lane at once, so the Philox rounds of several counters
+// overlap; only lanes that run past them after a ziggurat miss compute
+// more.
+template<typename V>
+struct lane_philox {
+    typedef typename V::vi vi;
+    typedef typename V::vd vd;
+    typedef typename V::mask mask;
+
+    // a cell and its 8 Moore neighbors take one draw each
+    static constexpr int buffered = 10;
+
+    lane_philox(uint64_t seed, uint64_t generation, int width) :
+        seed_{seed}, generation_{generation}, width_{width},
+        gen_lo{V::set1(static_cast<uint32_t>(generation))},
+        gen_hi{V::set1(static_cast<uint32_t>(generation >> 32))}
+    {
+        uint32_t k0 = static_cast<uint32_t>(seed), k1 = static_cast<uint32_t>(seed >> 32);
+        for(int round=0;round<10;++round) {
+            key0[round] = V::set1(k0);
+            key1[round] = V::set1(k1);
+            k0 += UINT32_C(0x9E3779B9);
+            k1 += UINT32_C(0xBB67AE85);
+        }
+    }
+
+    template<int D>
+    void start(int x, int y) {
+        static_assert(D <= buffered, "Too many draws to buffer.");
+        constexpr int B = (D+1)/2;
+        cell = V::add(V::set1(x+static_cast<uint64_t>(y)*width_), V::iota());
+        count = V::set1(0);
+        vi c[B][4];
+        for(int j=0;j<B;++j) {
+            c[j][3] = V::set1(j);
+        }
+        encrypt<B>(c);
+        for(int j=0;j<B;++j) {
+            V::store(draws[2*j], V::vor(V::template slli<32>(c[j][1]), c[j][0]));
+            V::store(draws[2*j+1], V::vor(V::template slli<32>(c[j][3]), c[j][2]));
+        }
+        drawn = 2*B;
+    }
+
+    vi get_raw(mask active) {
+        const vi last = V::set1(drawn-1);
+        mask beyond = V::gt(count, last);
+        vi index = V::add(V::template slli<(V::width == 8 ? 3 : 2)>(V::blend(beyond, count, last)), V::iota());
+        vi u = V::gather(&draws[0][0], index);
+        if(V::bits(V::mand(active, beyond)) != 0) {
+            vi c[1][4];
+            c[0][3] = V::template srli<1>(count);
+            encrypt<1>(c);
+            mask odd = V::eq(V::vand(count, V::set1(1)), V::set1(1));
+            vi more = V::blend(odd, V::vor(V::template slli<32>(c[0][1]), c[0][0]),
+                                    V::vor(V::template slli<32>(c[0][3]), c[0][2]));
+            u = V::blend(beyond, u, more);
+        }
+        count = V::add(count, V::blend(active, V::set1(0), V::set1(1)));
+        return u;
+    }
+
+    // Philox4x32-10 of B blocks of every lane, keeping the 32-bit words in
+    // 64-bit lanes. c[j][3] holds the block number on entry.
+    template<int B>
+    void encrypt(vi (&c)[B][4]) const {
+        const vi low = V::set1(UINT64_C(0xFFFFFFFF));
+        for(int j=0;j<B;++j) {
+            c[j][0] = V::vand(cell, low);
+            c[j][1] = gen_lo;
+            c[j][2] = gen_hi;
+        }
+        for(int round=0;round<10;++round) {
+            for(int j=0;j<B;++j) {
+                vi p0 = V::mul32(c[j][0], V::set1(UINT64_C(0xD2511F53)));
+                vi p1 = V::mul32(c[j][2], V::set1(UINT64_C(0xCD9E8D57)));
+                c[j][0] = V::vxor(V::vxor(V::template srli<32>(p1), c[j][1]), key0[round]);
+                c[j][1] = V::vand(p1, low);
+                c[j][2] = V::vxor(V::vxor(V::template srli<32>(p0), c[j][3]), key1[round]);
+                c[j][3] = V::vand(p0, low);
+            }
+        }
+    }
+
+    // Uniform (0,1) per lane, as in philox_stream::get_double52.
+    vd uniform() {
+        vi n = V::vor(V::template srli<11>(get_raw(V::eq(count, count))), V::set1(1));
+        return V::mul(to_double56<V>(n), V::set1d(1.0/9007199254740992.0));
+    }
+
+    // Finish the ziggurat draws {a[i],b[i]} of the lanes set in bits, each
+    // from where its stream stands.
+    void finish(int bits, const uint64_t *a, const uint64_t *b, double *x) {
+        uint64_t cells[V::width], counts[V::width];
+        V::store(cells, cell);
+        V::store(counts, count);
+        for(int i=0;i<V::width;++i) {
+            if(bits & (1 << i)) {
+                philox_stream rand(seed_, cells[i], generation_);
+                rand.seek(counts[i]);
+                x[i] = rand_exp_zig_slow(rand, static_cast<int64_t>(a[i]), b[i]);
+                counts[i] = rand.position();
+            }
+        }
+        count = V::load(counts);
+    }
+
+    template<typename N, engine_t E>
+    void update_cell(const pop_t &a, pop_t &b, int x, int y, color_count_t &color_count) {
+        update_cell_seeded<N>(a, b, x, y, seed_, generation_, color_count, E);
+    }
+
+    uint64_t seed_, generation_;
+    int width_;
+    vi gen_lo, gen_hi;
+    vi key0[10], key1[10];
+    vi cell, count;
+    // draws[n][i] is draw n of lane i, for n < drawn
+    int64_t draws[buffered][V::width];
+    int drawn;
+};
+
+// Exponential waiting times for the active lanes; inactive lanes are infinite.
+// The ziggurat's rectangle test is done in vector registers, and the rare
+// lanes that fall into a wedge or the tail are finished one at a time.
+template<typename V, typename L>
+inline typename V::vd race_weight(L &lanes, typename V::mask active, typename V::vd fitness)
+{
+    typedef typename V::vi vi;
+    typedef typename V::vd vd;
+    vi u = lanes.get_raw(active);
+    vi b = V::template srli<56>(u);
+    vi a = V::vand(u, V::set1(UINT64_C(0x00ffffffffffffff)));
+    typename V::mask redo = V::mand(active, V::gt(a, V::gather(ek, b)));
+    vd x = V::mul(to_double56<V>(a), V::gather(ew, b));
+    if(int bits = V::bits(redo)) {
+        double xs[V::width];
+        uint64_t as[V::width], bs[V::width];
+        V::stored(xs, x);
+        V::store(as, a);
+        V::store(bs, b);
+        lanes.finish(bits, as, bs, xs);
+        x = V::loadd(xs);
+    }
+    return V::blend(active, V::set1d(INFINITY), V::div(x, fitness));
+}
+
+// Colors and fitnesses of N consecutive cells.
+template<typename V>
+struct lane_cells {
+    typedef typename V::vi vi;
+    typedef typename V::vd vd;
+
+    lane_cells() = default;
+    lane_cells(const uint8_t *color, const double *fitness) :
+        c{V::loadc(color)}, f{V::loadd(fitness)} { }
+
+    vi c;
+    vd f;
+};
+
+// L supplies the random numbers: lane_rand or lane_philox.
+template<typename V, engine_t E, typename N, typename L>
+void update_rows_simd(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, L &lanes, color_count_t &color_count)
+{
+    typedef typename V::vi vi;
+    typedef typename V::vd vd;
+    typedef typename V::mask mask;
+    typedef lane_cells<V> cells;
+
+    const vi null_color = V::set1(null_allele);
+    const vi fertile_limit = V::set1(null_allele-1);
+
+    // the border of a is filled, so every block loads its neighbors directly
+    for(int y=y0;y<y1;++y) {
+        const uint8_t *color = a.color.data()+a.index(0,y);
+        const double *fitness = a.fitness.data()+a.index(0,y);
+        // candidate 0 is the cell itself
+        int offsets[N::size+1];
+        offsets[0] = 0;
+        N::offsets(a.stride, y, offsets+1);
+        for(const span_t &span : spans[y]) {
+            int x = span.x0;
+            for(;x+V::width <= span.x1; x += V::width) {
+                lanes.template start<(E == engine_t::draw) ? 1 : N::size+1>(x, y);
+                const cells c(color+x, fitness+x);
+                // null cells are never colonized
+                mask live = V::mnot(V::eq(c.c, null_color));
+
+                cells winner = c;
+                if(E == engine_t::draw) {
+                    // the first candidate whose cumulative fitness exceeds the
+                    // draw wins; blending from the back leaves the first one.
+                    // If the draw rounds up to the total, the last fertile
+                    // candidate wins, as in update_cell_draw.
+                    cells candidates[N::size+1];
+                    vd cumulative[N::size+1];
+                    vd total = V::set1d(0.0);
+                    for(int k=0;k<=N::size;++k) {
+                        candidates[k] = cells(color+x+offsets[k], fitness+x+offsets[k]);
+                        mask active = V::mand(live, V::gt(fertile_limit, candidates[k].c));
+                        total = V::add(total, V::blend(active, V::set1d(0.0), candidates[k].f));
+                        cumulative[k] = total;
+                        winner.c = V::blend(active, winner.c, candidates[k].c);
+                        winner.f = V::blend(active, winner.f, candidates[k].f);
+                    }
+                    vd draw = V::mul(lanes.uniform(), total);
+                    for(int k=N::size;k>=0;--k) {
+                        mask m = V::lt(draw, cumulative[k]);
+                        winner.c = V::blend(m, winner.c, candidates[k].c);
+                        winner.f = V::blend(m, winner.f, candidates[k].f);
+                    }
+                } else {
+                    vd weight = V::set1d(INFINITY);
+                    for(int k=0;k<=N::size;++k) {
+                        const cells n(color+x+offsets[k], fitness+x+offsets[k]);
+                        vd w = race_weight<V>(lanes, V::mand(live, V::gt(fertile_limit, n.c)), n.f);
+                        mask m = V::lt(w, weight);
+                        weight = V::blend(m, weight, w);
+                        winner.c = V::blend(m, winner.c, n.c);
+                        winner.f = V::blend(m, winner.f, n.f);
+                    }
+                }
+
+                V::stored(b.fitness.data()+a.index(x,y), winner.f);
+                uint64_t colors[V::width];
+                V::store(colors, winner.c);
+                uint8_t *out = b.color.data()+a.index(x,y);
+                int bits = V::bits(live);
+                for(int i=0;i<V::width;++i) {
+                    out[i] = static_cast<uint8_t>(colors[i]);
+                    if(bits & (1 << i)) {
+                        color_count[colors[i]] += 1;
+                    }
+                }
+            }
+            for(;x<span.x1;++x) {
+                lanes.template update_cell<N,E>(a, b, x, y, color_count);
+            }
+        }
+    }
+}
+
+template<typename V, typename L>
+void update_rows_simd(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, L &lanes, color_count_t &color_count, engine_t engine,
+    neighborhood_t neighborhood)
+{
+    switch(neighborhood) {
+    case neighborhood_t::moore:
+        if(engine == engine_t::draw) {
+            update_rows_simd<V,engine_t::draw,moore>(a, b, spans, y0, y1, lanes, color_count);
+        } else {
+            update_rows_simd<V,engine_t::race,moore>(a, b, spans, y0, y1, lanes, color_count);
+        }
+        break;
+    case neighborhood_t::hex:
+        if(engine == engine_t::draw) {
+            update_rows_simd<V,engine_t::draw,hex>(a, b, spans, y0, y1, lanes, color_count);
+        } else {
+            update_rows_simd<V,engine_t::race,hex>(a, b, spans, y0, y1, lanes, color_count);
+        }
+        break;
+    default:
+        if(engine == engine_t::draw) {
+            update_rows_simd<V,engine_t::draw,von_neumann>(a, b, spans, y0, y1, lanes, color_count);
+        } else {
+            update_rows_simd<V,engine_t::race,von_neumann>(a, b, spans, y0, y1, lanes, color_count);
+        }
+        break;
+    }
+}
+
+template<typename V>
+void update_rows_simd(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, xorshift64x8 &gen,
+    color_count_t &color_count, engine_t engine, neighborhood_t neighborhood)
+{
+    lane_rand<V> lanes(gen, rand);
+    update_rows_simd<V>(a, b, spans, y0, y1, lanes, color_count, engine, neighborhood);
+}
+
+template<typename V>
+void update_rows_seeded_simd(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine, neighborhood_t neighborhood)
+{
+    lane_philox<V> lanes(seed, generation, a.width);
+    update_rows_simd<V>(a, b, spans, y0, y1, lanes, color_count, engine, neighborhood);
+}
+
+} // anonymous namespace
+
+void update_rows_avx2(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, xorshift64x8 &gen,
+    color_count_t &color_count, engine_t engine, neighborhood_t neighborhood)
+{
+#if defined(__AVX2__)
+    update_rows_simd<avx2>(a, b, spans, y0, y1, rand, gen, color_count, engine, neighborhood);
+#else
+    update_rows_scalar(a, b, spans, y0, y1, rand, color_count, engine, neighborhood);
+#endif
+}
+
+void update_rows_avx512(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, xorshift64 &rand, xorshift64x8 &gen,
+    color_count_t &color_count, engine_t engine, neighborhood_t neighborhood)
+{
+#if defined(__AVX512F__)
+    update_rows_simd<avx512>(a, b, spans, y0, y1, rand, gen, color_count, engine, neighborhood);
+#else
+    update_rows_scalar(a, b, spans, y0, y1, rand, color_count, engine, neighborhood);
+#endif
+}
+
+void update_rows_seeded_avx2(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine, neighborhood_t neighborhood)
+{
+#if defined(__AVX2__)
+    update_rows_seeded_simd<avx2>(a, b, spans, y0, y1, seed, generation, color_count, engine, neighborhood);
+#else
+    update_rows_seeded(a, b, spans, y0, y1, seed, generation, color_count, engine, neighborhood);
+#endif
+}
+
+void update_rows_seeded_avx512(const pop_t &a, pop_t &b, const row_spans_t *spans,
+    int y0, int y1, uint64_t seed, uint64_t generation, color_count_t &color_count,
+    engine_t engine, neighborhood_t neighborhood)
+{
+#if defined(__AVX512F__)
+    update_rows_seeded_simd<avx512>(a, b, spans, y0, y1, seed, generation, color_count, engine, neighborhood);
+#else
+    update_rows_seeded(a, b, spans, y0, y1, seed, generation, color_count, engine, neighborhood);
+#endif
+}
+
+bool kernel_available(kernel_t kernel) {
+    switch(kernel) {
+    case kernel_t::automatic:
+    case kernel_t::scalar:
+        return true;
+    case kernel_t::avx2:
+#if defined(__AVX2__)
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    case kernel_t::avx512:
+#if defined(__AVX512F__)
+        return __builtin_cpu_supports("avx512f");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
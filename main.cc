@@ -1,4 +1,5 @@
 #include "sim1942.h"
+#include "mapfile.h"
 #include <gtkmm/application.h>
 #include <gtkmm/window.h>
 
@@ -6,11 +7,6 @@
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
-#include <boost/spirit/include/qi.hpp>
-#include <boost/fusion/include/std_pair.hpp>
-namespace spirit = boost::spirit;
-namespace qi = boost::spirit::qi;
-
 
 namespace boost { namespace program_options {
 
@@ -45,8 +41,6 @@ struct arg_t {
 
 arg_t process_command_line(po::options_description *opt_desc, int argc, char** argv);
 
-barriers_t process_map_file(const std::string& name);
-
 int main(int argc, char** argv) {
     Glib::set_application_name("1942");
 
@@ -95,12 +89,27 @@ int main(int argc, char** argv) {
         return 0;
     }
 
-    if(arg.width <= 0 || arg.height <= 0 || arg.mu <= 0.0) {
+    if(arg.rate < 0.0) {
         std::cerr << "Invalid command line arguments." << std::endl;
         return 1;
     }
+    worker_options_t options;
+#define XM(lname, sname, desc, type, def) options.XV(lname) = arg.XV(lname);
+#   include "worker.xmh"
+#undef XM
+    worker_arg_t worker_arg;
+    if(!make_worker_arg(&options, &worker_arg)) {
+        return 1;
+    }
+    worker_arg.rate = arg.rate;
+    // a resumed run replaces the size and mutation rate
+    arg.width = options.width;
+    arg.height = options.height;
+    arg.mu = options.mu;
+
     barriers_t barriers;
-    if(!arg.map_file.empty()) {
+    // a resumed run already holds its barriers
+    if(!arg.map_file.empty() && !worker_arg.resume) {
 		std::cout << "Reading map from file \"" << arg.map_file << "\".\n";
         barriers = process_map_file(arg.map_file);
         if(barriers.empty()) {
@@ -109,7 +118,18 @@ int main(int argc, char** argv) {
         }
     }
 
-    Sim1942 s(arg.width,arg.height,arg.mu,arg.delay);
+    std::unique_ptr<Sim1942> sim;
+    if(!arg.replay.empty()) {
+        std::unique_ptr<Replay> replay{new Replay(arg.replay, arg.replay_speed)};
+        if(!replay->is_open()) {
+            std::cerr << "Unable to read recording \"" << arg.replay << "\"." << std::endl;
+            return 2;
+        }
+        sim.reset(new Sim1942(std::move(replay)));
+    } else {
+        sim.reset(new Sim1942(arg.width,arg.height,arg.mu,arg.delay,worker_arg));
+    }
+    Sim1942 &s = *sim;
     s.name(arg.text.c_str());
     s.name_scale(arg.text_scale);
     if(!barriers.empty()) {
@@ -178,29 +198,3 @@ arg_t process_command_line(po::options_description *opt_desc, int argc, char** a
 
     return arg;
 }
-
-barriers_t process_map_file(const std::string& name) {
-    using qi::int_;
-    using qi::lexeme;
-    using qi::lit;
-
-    std::ifstream map_file(name, std::ios::binary);
-    if(!map_file) {
-        // unable to open file, return empty vector
-        return {};
-    }
-    map_file.unsetf(std::ios::skipws);
-
-    spirit::ascii::space_type space;
-    barriers_t map_data;
-
-    auto b = spirit::istream_iterator(map_file);
-    auto e = spirit::istream_iterator();
-    bool r = qi::phrase_parse(b, e, +(lexeme[int_] >> lit(',') >> int_),
-        space, qi::skip_flag::postskip, map_data);
-    if(!r || b != e) {
-        // parsing failed or was incomplete, return empty vector
-        return {};
-    }
-    return map_data;
-}
@@ -0,0 +1,35 @@
+#include "mapfile.h"
+
+#include <fstream>
+
+#include <boost/spirit/include/qi.hpp>
+#include <boost/spirit/include/support_istream_iterator.hpp>
+#include <boost/fusion/include/std_pair.hpp>
+namespace spirit = boost::spirit;
+namespace qi = boost::spirit::qi;
+
+barriers_t process_map_file(const std::string& name) {
+    using qi::int_;
+    using qi::lexeme;
+    using qi::lit;
+
+    std::ifstream map_file(name, std::ios::binary);
+    if(!map_file) {
+        // unable to open file, return empty vector
+        return {};
+    }
+    map_file.unsetf(std::ios::skipws);
+
+    spirit::ascii::space_type space;
+    barriers_t map_data;
+
+    auto b = spirit::istream_iterator(map_file);
+    auto e = spirit::istream_iterator();
+    bool r = qi::phrase_parse(b, e, +(lexeme[int_] >> lit(',') >> int_),
+        space, qi::skip_flag::postskip, map_data);
+    if(!r || b != e) {
+        // parsing failed or was incomplete, return empty vector
+        return {};
+    }
+    return map_data;
+}
@@ -0,0 +1,12 @@
+#ifndef CARTWRIGHT_MAPFILE_H
+#define CARTWRIGHT_MAPFILE_H
+
+#include <string>
+
+#include "worker.h"
+
+// Read a list of "x,y" barrier cells. Returns an empty list if the file
+// cannot be opened or parsed.
+barriers_t process_map_file(const std::string& name);
+
+#endif
@@ -0,0 +1,87 @@
+#pragma once
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+
+/*
+Philox4x32-10, a counter-based generator: every 128-bit counter is
+encrypted under a 64-bit key into 128 random bits, so any draw can be
+computed without generating the ones before it.
+
+Reference:
+Salmon JK, Moraes MA, Dror RO, Shaw DE (2011) Parallel random numbers:
+as easy as 1, 2, 3. Proceedings of SC11.
+*/
+
+inline void philox4x32_10(const uint32_t key[2], const uint32_t ctr[4], uint32_t out[4]) {
+	uint32_t k0 = key[0], k1 = key[1];
+	uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+	for(int round=0;round<10;++round) {
+		uint64_t p0 = UINT64_C(0xD2511F53)*c0;
+		uint64_t p1 = UINT64_C(0xCD9E8D57)*c2;
+		uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+		uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+		c0 = hi1^c1^k0;
+		c1 = lo1;
+		c2 = hi0^c3^k1;
+		c3 = lo0;
+		k0 += UINT32_C(0x9E3779B9);
+		k1 += UINT32_C(0xBB67AE85);
+	}
+	out[0] = c0; out[1] = c1; out[2] = c2; out[3] = c3;
+}
+
+// The stream of draws that belongs to one (key, a, b) triple, such as a
+// seed, a generation, and a cell. It has the same interface as xorshift64,
+// so the kernels and samplers can use either.
+class philox_stream {
+public:
+	philox_stream(uint64_t key, uint64_t a, uint64_t b) {
+		key_[0] = static_cast<uint32_t>(key);
+		key_[1] = static_cast<uint32_t>(key >> 32);
+		ctr_[0] = static_cast<uint32_t>(a);
+		ctr_[1] = static_cast<uint32_t>(b);
+		ctr_[2] = static_cast<uint32_t>(b >> 32);
+		ctr_[3] = 0;
+	}
+
+	uint64_t get_uint64() {
+		if(pos_ == 2) {
+			philox4x32_10(key_, ctr_, out_);
+			ctr_[3] += 1;
+			pos_ = 0;
+		}
+		uint64_t u = (static_cast<uint64_t>(out_[2*pos_+1]) << 32) | out_[2*pos_];
+		pos_ += 1;
+		return u;
+	}
+
+	// Uniform (0,1)
+	double get_double52() {
+		int64_t n = static_cast<int64_t>(get_uint64() >> 11) | 0x1;
+		return n/9007199254740992.0;
+	}
+
+	// The number of 64-bit draws taken so far.
+	uint64_t position() const {
+		return 2*static_cast<uint64_t>(ctr_[3]) + pos_ - 2;
+	}
+
+	// Continue as if n draws had been taken.
+	void seek(uint64_t n) {
+		ctr_[3] = static_cast<uint32_t>(n/2);
+		pos_ = 2;
+		if(n % 2 != 0) {
+			get_uint64();
+		}
+	}
+
+private:
+	uint32_t key_[2];
+	uint32_t ctr_[4];
+	uint32_t out_[4];
+	int pos_{2};
+};
+
+#endif
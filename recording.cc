@@ -0,0 +1,457 @@
+#include "recording.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+/************************************************************
+ * File format                                              *
+ ************************************************************/
+
+// A recording is a header followed by records and, if it was closed
+// properly, an index record and a trailer that points at it. Every record
+// has a record_header and a zlib stream of raw_size bytes. Keyframes hold
+// the color plane and then the fitness plane. Deltas hold the number of
+// runs and of changed cells as two uint32s, then a (skip, length) pair of
+// varints for every run of changed cells, then the colors of those cells,
+// then their fitnesses. The index is a record_index_t per record and is
+// not compressed. Numbers are stored in the byte order of the machine.
+
+namespace {
+
+const char recording_magic[8] = {'M','C','M','X','L','R','E','C'};
+const char index_magic[8] = {'M','C','M','X','L','I','D','X'};
+constexpr uint32_t recording_version = 1;
+
+enum : uint32_t { record_delta = 0, record_keyframe = 1, record_index = 2 };
+
+struct recording_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    int32_t width;
+    int32_t height;
+    uint32_t keyframe_interval;
+    uint32_t neighborhood;
+};
+
+struct record_header {
+    uint32_t type;
+    uint32_t size;
+    uint32_t raw_size;
+    uint32_t reserved;
+    uint64_t generation;
+};
+
+struct recording_trailer {
+    uint64_t index_offset;
+    char magic[8];
+};
+
+void put_varint(std::vector<uint8_t> *out, uint64_t v) {
+    while(v >= 0x80) {
+        out->push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out->push_back(static_cast<uint8_t>(v));
+}
+
+bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    *v = 0;
+    for(int shift = 0; *p < end && shift < 64; shift += 7) {
+        uint8_t b = *(*p)++;
+        *v |= static_cast<uint64_t>(b & 0x7F) << shift;
+        if(!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+void put_array(std::vector<uint8_t> *out, const T *data, size_t n) {
+    const uint8_t *p = reinterpret_cast<const uint8_t*>(data);
+    out->insert(out->end(), p, p+n*sizeof(T));
+}
+
+} // namespace
+
+/************************************************************
+ * recorder                                                 *
+ ************************************************************/
+
+recorder::recorder(const std::string &name, int width, int height,
+    neighborhood_t neighborhood, int keyframe_interval, size_t max_queue) :
+    width_{width}, height_{height}, keyframe_interval_{std::max(keyframe_interval,1)},
+    max_queue_{std::max<size_t>(max_queue,1)}
+{
+    out_ = std::fopen(name.c_str(), "wb");
+    if(out_ == nullptr) {
+        return;
+    }
+    recording_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, recording_magic, sizeof(h.magic));
+    h.version = recording_version;
+    h.header_size = sizeof(h);
+    h.width = width;
+    h.height = height;
+    h.keyframe_interval = keyframe_interval_;
+    h.neighborhood = static_cast<uint32_t>(neighborhood);
+    write(&h, sizeof(h));
+    thread_ = std::thread([this]{ write_thread(); });
+}
+
+recorder::~recorder() {
+    if(out_ == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_ = true;
+        ready_.notify_one();
+    }
+    thread_.join();
+    write_index();
+    if(std::fclose(out_) != 0) {
+        failed_ = true;
+    }
+    if(failed_) {
+        std::cerr << "Unable to write the recording." << std::endl;
+    }
+    if(dropped_ > 0) {
+        std::cerr << "The recording dropped " << dropped_ << " frame(s)." << std::endl;
+    }
+}
+
+void recorder::push(unsigned long long generation, const pop_t &pop) {
+    if(out_ == nullptr) {
+        return;
+    }
+    frame_t frame;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if(queue_.size() >= max_queue_) {
+            dropped_ += 1;
+            gap_ = true;
+            return;
+        }
+        if(!free_.empty()) {
+            frame = std::move(free_.back());
+            free_.pop_back();
+        }
+    }
+    frame.generation = generation;
+    frame.color.resize(width_*height_);
+    frame.fitness.resize(width_*height_);
+    for(int y=0;y<height_;++y) {
+        std::copy_n(pop.color.begin()+pop.index(0,y), width_, frame.color.begin()+y*width_);
+        std::copy_n(pop.fitness.begin()+pop.index(0,y), width_, frame.fitness.begin()+y*width_);
+    }
+    std::lock_guard<std::mutex> lock{mutex_};
+    // a frame after a gap cannot be a delta
+    queue_.emplace_back(std::move(frame), gap_);
+    gap_ = false;
+    ready_.notify_one();
+}
+
+void recorder::write_thread() {
+    for(;;) {
+        std::pair<frame_t,bool> item;
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            while(queue_.empty() && !stop_) {
+                ready_.wait(lock);
+            }
+            if(queue_.empty()) {
+                return;
+            }
+            item = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        bool keyframe = item.second || last_.color.empty()
+            || since_keyframe_ >= keyframe_interval_;
+        write_frame(item.first, keyframe);
+        std::swap(last_, item.first);
+        std::lock_guard<std::mutex> lock{mutex_};
+        free_.push_back(std::move(item.first));
+    }
+}
+
+void recorder::write_frame(const frame_t &frame, bool keyframe) {
+    const size_t cells = frame.color.size();
+    raw_.clear();
+    if(keyframe) {
+        put_array(&raw_, frame.color.data(), cells);
+        put_array(&raw_, frame.fitness.data(), cells);
+        write_record(record_keyframe, frame.generation, raw_);
+        since_keyframe_ = 1;
+        return;
+    }
+
+    // runs of cells whose color or fitness changed
+    uint32_t counts[2] = {0, 0};
+    put_array(&raw_, counts, 2);
+    run_color_.clear();
+    run_fitness_.clear();
+    size_t end = 0;
+    for(size_t i=0;i<cells;) {
+        if(frame.color[i] == last_.color[i] && frame.fitness[i] == last_.fitness[i]) {
+            ++i;
+            continue;
+        }
+        size_t j = i+1;
+        while(j < cells && (frame.color[j] != last_.color[j] || frame.fitness[j] != last_.fitness[j])) {
+            ++j;
+        }
+        put_varint(&raw_, i-end);
+        put_varint(&raw_, j-i);
+        run_color_.insert(run_color_.end(), frame.color.begin()+i, frame.color.begin()+j);
+        run_fitness_.insert(run_fitness_.end(), frame.fitness.begin()+i, frame.fitness.begin()+j);
+        counts[0] += 1;
+        end = i = j;
+    }
+    counts[1] = static_cast<uint32_t>(run_color_.size());
+    std::memcpy(raw_.data(), counts, sizeof(counts));
+    put_array(&raw_, run_color_.data(), run_color_.size());
+    put_array(&raw_, run_fitness_.data(), run_fitness_.size());
+    write_record(record_delta, frame.generation, raw_);
+    since_keyframe_ += 1;
+}
+
+void recorder::write_record(uint32_t type, unsigned long long generation,
+    const std::vector<uint8_t> &raw)
+{
+    uLongf size = compressBound(raw.size());
+    compressed_.resize(size);
+    // the fastest level keeps up with an uncapped run and still finds
+    // the long repeats in the fitness plane
+    if(compress2(compressed_.data(), &size, raw.data(), raw.size(), Z_BEST_SPEED) != Z_OK) {
+        failed_ = true;
+        return;
+    }
+    record_header h;
+    std::memset(&h, 0, sizeof(h));
+    h.type = type;
+    h.size = static_cast<uint32_t>(size);
+    h.raw_size = static_cast<uint32_t>(raw.size());
+    h.generation = generation;
+    uint64_t offset = offset_;
+    write(&h, sizeof(h));
+    write(compressed_.data(), size);
+    // index only records that are on disk
+    if(!failed_) {
+        index_.push_back({generation, offset, type, 0});
+    }
+}
+
+void recorder::write_index() {
+    record_header h;
+    std::memset(&h, 0, sizeof(h));
+    h.type = record_index;
+    h.size = h.raw_size = static_cast<uint32_t>(index_.size()*sizeof(record_index_t));
+    recording_trailer t;
+    t.index_offset = offset_;
+    std::memcpy(t.magic, index_magic, sizeof(t.magic));
+    write(&h, sizeof(h));
+    write(index_.data(), h.size);
+    write(&t, sizeof(t));
+}
+
+void recorder::write(const void *data, size_t size) {
+    if(!failed_ && std::fwrite(data, 1, size, out_) != size) {
+        failed_ = true;
+    }
+    offset_ += size;
+}
+
+/************************************************************
+ * recording_reader                                         *
+ ************************************************************/
+
+recording_reader::~recording_reader() {
+    if(data_ != nullptr) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+}
+
+bool recording_reader::open(const std::string &name) {
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(recording_header))) {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        return false;
+    }
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = st.st_size;
+
+    recording_header h;
+    std::memcpy(&h, data_, sizeof(h));
+    if(std::memcmp(h.magic, recording_magic, sizeof(h.magic)) != 0
+        || h.version != recording_version || h.header_size != sizeof(h)
+        || h.width <= 0 || h.height <= 0
+        || h.neighborhood > static_cast<uint32_t>(neighborhood_t::hex)) {
+        return false;
+    }
+    width_ = h.width;
+    height_ = h.height;
+    neighborhood_ = static_cast<neighborhood_t>(h.neighborhood);
+    records_.clear();
+    next_ = 0;
+
+    // use the index if the recording was closed properly
+    recording_trailer t;
+    std::memcpy(&t, data_+size_-sizeof(t), sizeof(t));
+    record_header ih;
+    if(size_ >= sizeof(h)+sizeof(ih)+sizeof(t)
+        && std::memcmp(t.magic, index_magic, sizeof(t.magic)) == 0
+        && t.index_offset >= sizeof(h) && t.index_offset <= size_-sizeof(ih)-sizeof(t)) {
+        std::memcpy(&ih, data_+t.index_offset, sizeof(ih));
+        size_t n = ih.size/sizeof(record_index_t);
+        if(ih.type == record_index && ih.size == n*sizeof(record_index_t)
+            && t.index_offset+sizeof(ih)+ih.size+sizeof(t) == size_) {
+            records_.resize(n);
+            std::memcpy(records_.data(), data_+t.index_offset+sizeof(ih), ih.size);
+            return true;
+        }
+    }
+    return scan();
+}
+
+bool recording_reader::scan() {
+    uint64_t offset = sizeof(recording_header);
+    record_header h;
+    while(offset+sizeof(h) <= size_) {
+        std::memcpy(&h, data_+offset, sizeof(h));
+        if(h.type == record_index || offset+sizeof(h)+h.size > size_) {
+            break;
+        }
+        records_.push_back({h.generation, offset, h.type, 0});
+        offset += sizeof(h)+h.size;
+    }
+    return true;
+}
+
+unsigned long long recording_reader::first_generation() const {
+    return records_.empty() ? 0 : records_.front().generation;
+}
+
+unsigned long long recording_reader::last_generation() const {
+    return records_.empty() ? 0 : records_.back().generation;
+}
+
+bool recording_reader::seek(unsigned long long generation, frame_t *frame) {
+    auto it = std::upper_bound(records_.begin(), records_.end(), generation,
+        [](unsigned long long g, const record_index_t &r) { return g < r.generation; });
+    if(it == records_.begin()) {
+        return false;
+    }
+    size_t i = (it-records_.begin())-1;
+    size_t k = i;
+    while(k > 0 && records_[k].type != record_keyframe) {
+        --k;
+    }
+    for(;k<=i;++k) {
+        if(!decode(k, frame)) {
+            return false;
+        }
+    }
+    next_ = i+1;
+    return true;
+}
+
+bool recording_reader::next(frame_t *frame) {
+    if(next_ >= records_.size() || !decode(next_, frame)) {
+        return false;
+    }
+    next_ += 1;
+    return true;
+}
+
+bool recording_reader::decode(size_t i, frame_t *frame) {
+    const record_index_t &r = records_[i];
+    record_header h;
+    if(r.offset+sizeof(h) > size_) {
+        return false;
+    }
+    std::memcpy(&h, data_+r.offset, sizeof(h));
+    if(r.offset+sizeof(h)+h.size > size_) {
+        return false;
+    }
+    buffer_.resize(h.raw_size);
+    uLongf size = h.raw_size;
+    if(uncompress(buffer_.data(), &size, data_+r.offset+sizeof(h), h.size) != Z_OK
+        || size != h.raw_size) {
+        return false;
+    }
+
+    const size_t cells = static_cast<size_t>(width_)*height_;
+    const uint8_t *p = buffer_.data();
+    const uint8_t *end = p+buffer_.size();
+    // colors index the palette, so none may exceed the null allele
+    auto valid_colors = [](const uint8_t *first, const uint8_t *last) {
+        return std::all_of(first, last, [](uint8_t c) { return c <= null_allele; });
+    };
+    if(h.type == record_keyframe) {
+        if(buffer_.size() != cells*(1+sizeof(double)) || !valid_colors(p, p+cells)) {
+            return false;
+        }
+        frame->color.assign(p, p+cells);
+        frame->fitness.resize(cells);
+        std::memcpy(frame->fitness.data(), p+cells, cells*sizeof(double));
+        frame->generation = h.generation;
+        return true;
+    }
+    if(h.type != record_delta || frame->color.size() != cells || buffer_.size() < 8) {
+        return false;
+    }
+
+    uint32_t counts[2];
+    std::memcpy(counts, p, sizeof(counts));
+    p += sizeof(counts);
+    // find where the runs end and the cell data starts
+    const uint8_t *q = p;
+    uint64_t v;
+    for(uint32_t k=0;k<2*counts[0];++k) {
+        if(!get_varint(&q, end, &v)) {
+            return false;
+        }
+    }
+    const uint8_t *color = q;
+    const uint8_t *fitness = q+counts[1];
+    if(static_cast<size_t>(end-q) != counts[1]*(1+sizeof(double))
+        || !valid_colors(color, color+counts[1])) {
+        return false;
+    }
+    uint64_t pos = 0, n = 0;
+    for(uint32_t k=0;k<counts[0];++k) {
+        uint64_t skip, length;
+        get_varint(&p, q, &skip);
+        get_varint(&p, q, &length);
+        pos += skip;
+        if(pos+length > cells || n+length > counts[1]) {
+            return false;
+        }
+        std::copy_n(color+n, length, frame->color.begin()+pos);
+        std::memcpy(&frame->fitness[pos], fitness+n*sizeof(double), length*sizeof(double));
+        pos += length;
+        n += length;
+    }
+    frame->generation = h.generation;
+    return true;
+}
@@ -0,0 +1,138 @@
+#ifndef CARTWRIGHT_RECORDING_H
+#define CARTWRIGHT_RECORDING_H
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "worker.h"
+
+// A recording stores every generation of a run. Every keyframe_interval
+// frames, and after any frame that had to be dropped, the whole grid is
+// written; the frames in between only hold the cells that changed, as runs
+// of colors and fitnesses. Every record is compressed with zlib, and an
+// index of the keyframes at the end of the file lets a reader seek without
+// decoding the whole run.
+
+// The grid of one generation, without the border.
+struct frame_t {
+    unsigned long long generation{0};
+    colors_t color;
+    std::vector<double> fitness;
+};
+
+// Where a record starts; the index at the end of a recording lists one per
+// record.
+struct record_index_t {
+    uint64_t generation;
+    uint64_t offset;
+    uint32_t type;
+    uint32_t reserved;
+};
+
+// Writes a recording on a background thread. push() only copies the grid
+// into a free buffer, so recording never waits on compression or the disk.
+class recorder {
+public:
+    recorder(const std::string &name, int width, int height, neighborhood_t neighborhood,
+        int keyframe_interval = 300, size_t max_queue = 16);
+    // Write the frames still queued and the keyframe index.
+    ~recorder();
+
+    bool is_open() const {
+        return out_ != nullptr;
+    }
+
+    // Queue the grid of pop. If max_queue frames are already waiting, the
+    // frame is dropped and the next one is written as a keyframe.
+    void push(unsigned long long generation, const pop_t &pop);
+
+private:
+    void write_thread();
+    void write_frame(const frame_t &frame, bool keyframe);
+    void write_record(uint32_t type, unsigned long long generation,
+        const std::vector<uint8_t> &raw);
+    void write_index();
+    void write(const void *data, size_t size);
+
+    int width_, height_;
+    int keyframe_interval_;
+    size_t max_queue_;
+    FILE *out_{nullptr};
+    uint64_t offset_{0};
+
+    // frames waiting to be written and buffers ready for reuse
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::pair<frame_t,bool>> queue_;
+    std::vector<frame_t> free_;
+    bool stop_{false};
+    bool gap_{false};
+    unsigned long long dropped_{0};
+    std::thread thread_;
+
+    // owned by the write thread
+    frame_t last_;
+    int since_keyframe_{0};
+    bool failed_{false};
+    std::vector<uint8_t> raw_, compressed_;
+    colors_t run_color_;
+    std::vector<double> run_fitness_;
+    std::vector<record_index_t> index_;
+};
+
+// Reads a recording through a memory map.
+class recording_reader {
+public:
+    recording_reader() = default;
+    ~recording_reader();
+    recording_reader(const recording_reader&) = delete;
+    recording_reader& operator=(const recording_reader&) = delete;
+
+    // Returns false if the file cannot be mapped or is not a recording. A
+    // recording that was cut short has no index; its record headers are
+    // scanned instead.
+    bool open(const std::string &name);
+
+    int width() const {
+        return width_;
+    }
+    int height() const {
+        return height_;
+    }
+    // The lattice of the recorded run, which decides how it is drawn.
+    neighborhood_t neighborhood() const {
+        return neighborhood_;
+    }
+    // Generations of the first and last frames.
+    unsigned long long first_generation() const;
+    unsigned long long last_generation() const;
+
+    // Decode the last frame at or before generation into frame. The index
+    // finds the frame and its keyframe, so no more than one keyframe
+    // interval of records is read.
+    bool seek(unsigned long long generation, frame_t *frame);
+    // Decode the frame after the one last returned into the same frame.
+    // Returns false at the end.
+    bool next(frame_t *frame);
+
+private:
+    bool scan();
+    // Apply record i to frame, which must hold record i-1 unless i is a
+    // keyframe.
+    bool decode(size_t i, frame_t *frame);
+
+    const uint8_t *data_{nullptr};
+    size_t size_{0};
+    int width_{0}, height_{0};
+    neighborhood_t neighborhood_{neighborhood_t::von_neumann};
+    std::vector<record_index_t> records_;
+    size_t next_{0};
+    std::vector<uint8_t> buffer_;
+};
+
+#endif
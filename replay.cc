@@ -0,0 +1,112 @@
+#include "replay.h"
+
+#include <algorithm>
+#include <chrono>
+
+// how often the playback position is sampled
+constexpr double replay_frame_rate = 30.0;
+// further ahead than this, seeking from a keyframe beats stepping forward
+constexpr unsigned long long replay_max_steps = 64;
+
+Replay::Replay(const std::string &name, double speed) : speed_{speed} {
+    open_ = reader_.open(name) && reader_.seek(reader_.first_generation(), &frame_);
+    position_ = reader_.first_generation();
+    // a null grid until the first frame is shown
+    frames_.reset(new snapshot_publisher(width(), height()));
+    colors_t null_grid(width()*height(), null_allele);
+    frames_->publish(null_grid.data(), width(), 0);
+}
+
+void Replay::stop() {
+    std::lock_guard<std::mutex> lock{sync_mutex_};
+    go_ = false;
+    sync_.notify_one();
+}
+
+void Replay::do_work(std::function<void()> on_frame) {
+    typedef std::chrono::steady_clock clock;
+    go_ = true;
+    const auto period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0/replay_frame_rate));
+    const double first = reader_.first_generation();
+    const double last = reader_.last_generation();
+    auto then = clock::now();
+    auto next = then;
+
+    while(go_) {
+        auto now = clock::now();
+        double elapsed = std::chrono::duration<double>(now-then).count();
+        then = now;
+        unsigned long long target;
+        {
+            std::lock_guard<std::mutex> lock{control_mutex_};
+            if(!paused_) {
+                position_ += speed_*elapsed;
+            }
+            position_ = std::min(std::max(position_, first), last);
+            target = static_cast<unsigned long long>(position_);
+        }
+        if(show(target)) {
+            on_frame();
+        }
+
+        next = std::max(next + period, now);
+        std::unique_lock<std::mutex> slock{sync_mutex_};
+        sync_.wait_until(slock, next, [this]{ return !go_; });
+    }
+}
+
+bool Replay::show(unsigned long long generation) {
+    if(have_frame_ && generation == shown_) {
+        return false;
+    }
+    bool ok = false;
+    if(have_frame_ && frame_.generation < generation
+        && generation-frame_.generation <= replay_max_steps) {
+        // step forward through the deltas
+        ok = true;
+        while(ok && frame_.generation < generation) {
+            ok = reader_.next(&frame_);
+        }
+    }
+    if(!ok) {
+        ok = reader_.seek(generation, &frame_);
+    }
+    have_frame_ = ok;
+    shown_ = generation;
+    if(!ok) {
+        return false;
+    }
+    frames_->publish(frame_.color.data(), width(), frame_.generation);
+    return true;
+}
+
+void Replay::set_speed(double speed) {
+    std::lock_guard<std::mutex> lock{control_mutex_};
+    speed_ = speed;
+}
+
+double Replay::speed() const {
+    std::lock_guard<std::mutex> lock{control_mutex_};
+    return speed_;
+}
+
+void Replay::toggle_pause() {
+    std::lock_guard<std::mutex> lock{control_mutex_};
+    paused_ = !paused_;
+}
+
+bool Replay::paused() const {
+    std::lock_guard<std::mutex> lock{control_mutex_};
+    return paused_;
+}
+
+void Replay::skip(double delta) {
+    std::lock_guard<std::mutex> lock{control_mutex_};
+    position_ += delta;
+}
+
+void Replay::jump(unsigned long long generation) {
+    std::lock_guard<std::mutex> lock{control_mutex_};
+    position_ = generation;
+}
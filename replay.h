@@ -0,0 +1,82 @@
+#ifndef CARTWRIGHT_REPLAY_H
+#define CARTWRIGHT_REPLAY_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "recording.h"
+
+// Plays back a recording in place of a Worker. The playback position moves
+// at speed generations per second, backwards if speed is negative, and can
+// jump anywhere; frames are decoded on the thread that runs do_work and
+// published through the same latest() as the Worker.
+class Replay
+{
+public:
+    Replay(const std::string &name, double speed);
+
+    bool is_open() const {
+        return open_;
+    }
+    int width() const {
+        return reader_.width();
+    }
+    int height() const {
+        return reader_.height();
+    }
+    neighborhood_t neighborhood() const {
+        return reader_.neighborhood();
+    }
+
+    // Thread function. Decodes the frame at the playback position several
+    // times a second until stopped and calls on_frame after each new one.
+    void do_work(std::function<void()> on_frame);
+    void stop();
+
+    // The newest decoded frame; see Worker::latest.
+    const snapshot_t& latest() {
+        return frames_->latest();
+    }
+    bool pending() const {
+        return frames_->pending();
+    }
+
+    // Playback controls, safe to call from any thread.
+    void set_speed(double speed);
+    double speed() const;
+    void toggle_pause();
+    bool paused() const;
+    // Jump by delta generations, or to generation.
+    void skip(double delta);
+    void jump(unsigned long long generation);
+
+private:
+    // Decode the last frame at or before generation into frame_ and publish
+    // it. Returns false if nothing changed.
+    bool show(unsigned long long generation);
+
+    recording_reader reader_;
+    bool open_{false};
+    frame_t frame_;
+    unsigned long long shown_{0};
+    bool have_frame_{false};
+
+    // guarded by control_mutex_
+    mutable std::mutex control_mutex_;
+    double speed_;
+    double position_{0.0};
+    bool paused_{false};
+
+    // sized once the recording is open
+    std::unique_ptr<snapshot_publisher> frames_;
+
+    std::atomic<bool> go_{false};
+    std::condition_variable sync_;
+    std::mutex sync_mutex_;
+};
+
+#endif
@@ -1,6 +1,11 @@
 #include <cstdint>
+#include <algorithm>
 #include "rexp.h"
 
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#endif
+
 /************************************************************
  * Tables for exponential                                   *
  ************************************************************/
@@ -207,3 +212,144 @@ const int64_t ek[256] = {
 	N(0xF51530F0916D88), N(0xF2CB0E3C5933E8), N(0xEEEFB15D605D88), N(0xE6DA6ECF274600)
 };
 #undef N
+
+/************************************************************
+ * Batched variates                                         *
+ ************************************************************/
+
+namespace {
+
+// Tables for 32-bit draws, which use the top 8 bits for b and the low 24
+// bits for a. They are the 56-bit tables scaled down by 2^32.
+struct zig_tables_f {
+	zig_tables_f() {
+		for(int i=0;i<256;++i) {
+			k[i] = static_cast<int32_t>(ek[i] >> 32);
+			w[i] = static_cast<float>(ew[i]*4294967296.0);
+		}
+	}
+	int32_t k[256];
+	float w[256];
+};
+
+const zig_tables_f zigf;
+
+const size_t zig_block = 256;
+
+
+// Finish the draws of a block that missed their rectangles; bit i of miss
+// is set if draw i missed.
+template<typename T, typename F>
+inline void zig_finish(const uint64_t *miss, size_t m, T *out, F finish) {
+	for(size_t w=0;w*64<m;++w) {
+		for(uint64_t bits = miss[w]; bits != 0; bits &= bits-1) {
+			size_t i = w*64+__builtin_ctzll(bits);
+			out[i] = finish(i);
+		}
+	}
+}
+
+}
+
+void rand_exp_zig(xorshift64 &rng, double *out, size_t n) {
+	uint64_t u[zig_block];
+	uint64_t miss[zig_block/64];
+	while(n > 0) {
+		size_t m = std::min(n, zig_block);
+		for(size_t i=0;i<m;++i)
+			u[i] = rng.get_uint64();
+		std::fill(miss, miss+zig_block/64, 0);
+		size_t i = 0;
+#if defined(__AVX512F__)
+		const __m512i amask = _mm512_set1_epi64(0x00ffffffffffffff);
+		for(;i+8<=m;i+=8) {
+			__m512i v = _mm512_loadu_si512(u+i);
+			__m512i b = _mm512_srli_epi64(v, 56);
+			__m512i a = _mm512_and_si512(v, amask);
+			__mmask8 k = _mm512_cmpgt_epi64_mask(a, _mm512_i64gather_epi64(b, ek, 8));
+			__m512d x = _mm512_fmadd_pd(
+				_mm512_cvtepi32_pd(_mm512_cvtepi64_epi32(_mm512_srli_epi64(a, 28))),
+				_mm512_set1_pd(268435456.0),
+				_mm512_cvtepi32_pd(_mm512_cvtepi64_epi32(_mm512_and_si512(a, _mm512_set1_epi64(0xFFFFFFF)))));
+			_mm512_storeu_pd(out+i, _mm512_mul_pd(x, _mm512_i64gather_pd(b, ew, 8)));
+			miss[i/64] |= static_cast<uint64_t>(k) << (i%64);
+		}
+#elif defined(__AVX2__)
+		const __m256i amask = _mm256_set1_epi64x(0x00ffffffffffffff);
+		const __m256i magic = _mm256_set1_epi64x(0x4330000000000000); // 2^52
+		const __m256d two52 = _mm256_set1_pd(4503599627370496.0);
+		for(;i+4<=m;i+=4) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u+i));
+			__m256i b = _mm256_srli_epi64(v, 56);
+			__m256i a = _mm256_and_si256(v, amask);
+			__m256i k = _mm256_cmpgt_epi64(a, _mm256_i64gather_epi64(reinterpret_cast<const long long*>(ek), b, 8));
+			__m256d hi = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(a, 28), magic)), two52);
+			__m256d lo = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(
+				_mm256_and_si256(a, _mm256_set1_epi64x(0xFFFFFFF)), magic)), two52);
+			__m256d x = _mm256_add_pd(_mm256_mul_pd(hi, _mm256_set1_pd(268435456.0)), lo);
+			_mm256_storeu_pd(out+i, _mm256_mul_pd(x, _mm256_i64gather_pd(ew, b, 8)));
+			miss[i/64] |= static_cast<uint64_t>(_mm256_movemask_pd(_mm256_castsi256_pd(k))) << (i%64);
+		}
+#endif
+		for(;i<m;++i) {
+			uint64_t b = u[i] >> 56;
+			int64_t a = static_cast<int64_t>(u[i] & UINT64_C(0x00ffffffffffffff));
+			out[i] = a*ew[b];
+			miss[i/64] |= static_cast<uint64_t>(a > ek[b]) << (i%64);
+		}
+		zig_finish(miss, m, out, [&](size_t j) {
+			return rand_exp_zig_slow(rng,
+				static_cast<int64_t>(u[j] & UINT64_C(0x00ffffffffffffff)), u[j] >> 56);
+		});
+		out += m;
+		n -= m;
+	}
+}
+
+void rand_exp_zig(xorshift64 &rng, float *out, size_t n) {
+	uint32_t u[zig_block];
+	uint64_t miss[zig_block/64];
+	while(n > 0) {
+		size_t m = std::min(n, zig_block);
+		for(size_t i=0;i<m;i+=2) {
+			std::pair<uint32_t,uint32_t> p = rng.get_uint32_pair();
+			u[i] = p.first;
+			u[i+1] = p.second;
+		}
+		std::fill(miss, miss+zig_block/64, 0);
+		size_t i = 0;
+#if defined(__AVX512F__)
+		for(;i+16<=m;i+=16) {
+			__m512i v = _mm512_loadu_si512(u+i);
+			__m512i b = _mm512_srli_epi32(v, 24);
+			__m512i a = _mm512_and_si512(v, _mm512_set1_epi32(0x00ffffff));
+			__mmask16 k = _mm512_cmpgt_epi32_mask(a, _mm512_i32gather_epi32(b, zigf.k, 4));
+			__m512 x = _mm512_mul_ps(_mm512_cvtepi32_ps(a), _mm512_i32gather_ps(b, zigf.w, 4));
+			_mm512_storeu_ps(out+i, x);
+			miss[i/64] |= static_cast<uint64_t>(k) << (i%64);
+		}
+#elif defined(__AVX2__)
+		for(;i+8<=m;i+=8) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u+i));
+			__m256i b = _mm256_srli_epi32(v, 24);
+			__m256i a = _mm256_and_si256(v, _mm256_set1_epi32(0x00ffffff));
+			__m256i k = _mm256_cmpgt_epi32(a, _mm256_i32gather_epi32(zigf.k, b, 4));
+			__m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(a), _mm256_i32gather_ps(zigf.w, b, 4));
+			_mm256_storeu_ps(out+i, x);
+			miss[i/64] |= static_cast<uint64_t>(_mm256_movemask_ps(_mm256_castsi256_ps(k))) << (i%64);
+		}
+#endif
+		for(;i<m;++i) {
+			uint32_t b = u[i] >> 24;
+			int32_t a = static_cast<int32_t>(u[i] & UINT32_C(0x00ffffff));
+			out[i] = a*zigf.w[b];
+			miss[i/64] |= static_cast<uint64_t>(a > zigf.k[b]) << (i%64);
+		}
+		zig_finish(miss, m, out, [&](size_t j) {
+			int64_t a = static_cast<int64_t>(u[j] & UINT32_C(0x00ffffff)) << 32;
+			return static_cast<float>(rand_exp_zig_slow(rng, a, u[j] >> 24));
+		});
+		out += m;
+		n -= m;
+	}
+}
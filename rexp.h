@@ -6,6 +6,7 @@
 #include <cmath>
 #include <cfloat>
 #include <cassert>
+#include <cstddef>
 
 #include "xorshift64.h"
 
@@ -13,15 +14,17 @@ extern const double ew[256];
 extern const double ef[256];
 extern const int64_t ek[256];
 
-inline double rand_exp_inv(xorshift64 &rng) { return -log(rng.get_double52()); }
+// The single-draw samplers work with any generator that has get_uint64
+// and get_double52, such as xorshift64 or philox_stream.
 
-inline double rand_exp_zig(xorshift64 &rng) {
+template<typename RNG>
+inline double rand_exp_inv(RNG &rng) { return -log(rng.get_double52()); }
+
+// Finish a ziggurat draw whose point {a,b} fell outside of rectangle b.
+template<typename RNG>
+inline double rand_exp_zig_slow(RNG &rng, int64_t a, uint64_t b) {
 	const double r = 7.69711747013104972;
-	uint64_t u = rng.get_uint64();
-	// use the top 8 high bits for b
-	uint64_t b = u >> 56;
-	// use the rest for a
-	int64_t a = static_cast<int64_t>(u & UINT64_C(0x00ffffffffffffff)); 
+	uint64_t u;
 	while( a > ek[b] ) {
 		if(b == 0)
 			return r+rand_exp_inv(rng);
@@ -33,16 +36,56 @@ inline double rand_exp_zig(xorshift64 &rng) {
 		b = u >> 56;
 		a = static_cast<int64_t>(u & UINT64_C(0x00ffffffffffffff)); 
 	}
-	
 	return a*ew[b];
 }
 
-inline double rand_exp(xorshift64 &rng, double rate = 1.0) {
+template<typename RNG>
+inline double rand_exp_zig(RNG &rng) {
+	uint64_t u = rng.get_uint64();
+	// use the top 8 high bits for b
+	uint64_t b = u >> 56;
+	// use the rest for a
+	int64_t a = static_cast<int64_t>(u & UINT64_C(0x00ffffffffffffff)); 
+	if( a <= ek[b] )
+		return a*ew[b];
+	return rand_exp_zig_slow(rng, a, b);
+}
+
+// Fill out[0..n) with unit exponential variates. The rectangle test of the
+// ziggurat is done for a block of draws in a loop that the compiler can
+// vectorize, and the rare draws that miss their rectangle are finished
+// afterwards. The float version uses 32-bit draws, two per random number.
+void rand_exp_zig(xorshift64 &rng, double *out, size_t n);
+void rand_exp_zig(xorshift64 &rng, float *out, size_t n);
+
+// Hands out unit exponential variates that are generated in batches.
+class rand_exp_buffer {
+public:
+	explicit rand_exp_buffer(xorshift64 &rng) : rng_(rng) { }
+
+	double operator()() {
+		if(pos_ == size) {
+			rand_exp_zig(rng_, buf_, size);
+			pos_ = 0;
+		}
+		return buf_[pos_++];
+	}
+
+private:
+	static constexpr int size = 256;
+	xorshift64 &rng_;
+	double buf_[size];
+	int pos_{size};
+};
+
+template<typename RNG>
+inline double rand_exp(RNG &rng, double rate = 1.0) {
 	assert(rate > 0.0);
 	return rand_exp_zig(rng)/rate;
 }
 
-inline double rand_exp_trunc(xorshift64 &rng, double lim, double rate = 1.0) {
+template<typename RNG>
+inline double rand_exp_trunc(RNG &rng, double lim, double rate = 1.0) {
 	double u = rng.get_double52();
 	return -log1p(u*(expm1(-rate*lim)))/rate;
 }
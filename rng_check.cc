@@ -0,0 +1,125 @@
+// Checks xorshift64_lanes against the scalar xorshift64: every lane must be
+// the scalar stream jumped ahead by i*2^58 draws, and every lane must pass
+// the same battery as the scalar generator. Exits nonzero on a failure.
+
+#include "xorshift64.h"
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace {
+
+// draws per battery
+constexpr int sample_size = 1 << 20;
+// statistics are approximately standard normal; a seeded run is fixed, so
+// a wide bound only has to catch a broken generator
+constexpr double max_z = 5.0;
+
+int failures = 0;
+
+void report(const std::string &name, const char *test, double z) {
+    bool ok = std::fabs(z) < max_z;
+    std::printf("  %-14s %-18s z = %7.3f  %s\n", name.c_str(), test, z, ok ? "ok" : "FAIL");
+    if(!ok) {
+        failures += 1;
+    }
+}
+
+// Uniformity of the top 8 bits, serial correlation of consecutive draws as
+// doubles, and the balance of every bit.
+void battery(const std::string &name, std::function<uint64_t()> next) {
+    std::vector<uint64_t> draws(sample_size);
+    for(auto &d : draws) {
+        d = next();
+    }
+
+    double bins[256] = {0};
+    for(auto d : draws) {
+        bins[d >> 56] += 1.0;
+    }
+    double expected = sample_size/256.0, chi2 = 0.0;
+    for(double b : bins) {
+        chi2 += (b-expected)*(b-expected)/expected;
+    }
+    report(name, "uniformity", (chi2-255.0)/std::sqrt(2.0*255.0));
+
+    double sx = 0.0, sxx = 0.0, sxy = 0.0;
+    double prev = (draws[0] >> 11)/9007199254740992.0;
+    for(int i=1;i<sample_size;++i) {
+        double x = (draws[i] >> 11)/9007199254740992.0;
+        sx += prev;
+        sxx += prev*prev;
+        sxy += prev*x;
+        prev = x;
+    }
+    double n = sample_size-1, mean = sx/n;
+    double r = (sxy/n - mean*mean)/(sxx/n - mean*mean);
+    report(name, "serial correlation", r*std::sqrt(n));
+
+    double worst = 0.0;
+    for(int bit=0;bit<64;++bit) {
+        double ones = 0.0;
+        for(auto d : draws) {
+            ones += (d >> bit) & 1;
+        }
+        double z = (ones - sample_size/2.0)/std::sqrt(sample_size/4.0);
+        if(std::fabs(z) > std::fabs(worst)) {
+            worst = z;
+        }
+    }
+    report(name, "worst bit balance", worst);
+}
+
+template<int N>
+void check_lanes(uint64_t seed1, uint64_t seed2) {
+    std::printf("xorshift64_lanes<%d> seeded with %llu, %llu\n", N,
+        static_cast<unsigned long long>(seed1), static_cast<unsigned long long>(seed2));
+
+    // lane i against the scalar generator jumped by i*2^58
+    xorshift64_lanes<N> lanes(seed1, seed2);
+    xorshift64 scalar[N];
+    for(int i=0;i<N;++i) {
+        scalar[i].seed(seed1, seed2);
+        scalar[i].jump(static_cast<uint64_t>(i) << 58);
+    }
+    int mismatches = 0;
+    uint64_t out[N];
+    for(int k=0;k<10000;++k) {
+        lanes.get_raw(out);
+        for(int i=0;i<N;++i) {
+            mismatches += (out[i] != scalar[i].get_raw());
+        }
+    }
+    std::printf("  lanes equal the jumped scalar streams: %s\n", mismatches == 0 ? "ok" : "FAIL");
+    if(mismatches != 0) {
+        failures += 1;
+    }
+
+    xorshift64 reference(seed1, seed2);
+    battery("scalar", [&]{ return reference.get_raw(); });
+    for(int i=0;i<N;++i) {
+        // draw the lanes together, as the kernels do, and test each one
+        xorshift64_lanes<N> g(seed1, seed2);
+        battery("lane " + std::to_string(i), [&g,i]{
+            uint64_t r[N];
+            g.get_raw(r);
+            return r[i];
+        });
+    }
+}
+
+} // namespace
+
+int main() {
+    check_lanes<4>(0, 0);
+    check_lanes<8>(12345, 67890);
+    if(failures != 0) {
+        std::printf("%d check(s) failed.\n", failures);
+        return 1;
+    }
+    std::printf("All checks passed.\n");
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <cmath>
 #include <cassert>
+#include <climits>
 #include <algorithm>
 #include <cairomm/context.h>
 #include <glibmm/main.h>
@@ -13,23 +14,58 @@
 
 #include "logo.inl"
 
-#define OUR_FRAME_RATE 15
 #define OVERLAY_ALPHA 0.85
 
 const char normal_icons[] = u8"\uf12d   \uf26c";
 const char active_eraser_icons[] = u8"<span foreground='#FFF68FE6'>\uf12d</span>   \uf26c";
 
-Sim1942::Sim1942(int width, int height, double mu, int delay) :
+Sim1942::Sim1942(int width, int height, double mu, int delay, const worker_arg_t &opt) :
     grid_width_{width}, grid_height_{height}, mu_(mu),
-    worker_{width,height,mu,delay}
+    hex_{opt.neighborhood == neighborhood_t::hex},
+    worker_{width,height,mu,delay,opt}
 {
-    //Glib::signal_timeout().connect(sigc::mem_fun(*this, &Sim1942::on_timeout), 1000.0/OUR_FRAME_RATE );
+    if(opt.rate > 0.0) {
+        // on_tick releases each generation on the frame it is due
+        worker_.pace_externally();
+        generation_period_ = static_cast<gint64>(1e6/opt.rate);
+    }
+    init();
+}
 
-    Glib::signal_timeout().connect([&]() -> bool {
-        this->worker_.do_next_generation(); return true;
-        }, 1000.0/OUR_FRAME_RATE );
+// The worker of a replay stays idle, so it gets the smallest grid.
+Sim1942::Sim1942(std::unique_ptr<Replay> replay) :
+    grid_width_{replay->width()}, grid_height_{replay->height()}, mu_(0.0),
+    hex_{replay->neighborhood() == neighborhood_t::hex},
+    worker_{1,1,1.0},
+    replay_{std::move(replay)}
+{
+    init();
+}
+
+void Sim1942::init() {
+    // Odd rows of a hex grid are shifted by half a cell, so every cell
+    // spans two pixels and whole rows can move by one.
+    raster_width_ = (hex_ ? 2 : 1)*grid_width_;
+    tiles_x_ = (grid_width_+tile_size-1)/tile_size;
+    tiles_y_ = (grid_height_+tile_size-1)/tile_size;
+    // Passing each slot of rasters_ through once gives all three a blank
+    // surface and leaves nothing pending for the GUI thread.
+    for(int i=0;i<3;++i) {
+        raster_t &raster = rasters_.back();
+        raster.surface = Cairo::ImageSurface::create(Cairo::FORMAT_ARGB32,
+            raster_width_, grid_height_);
+        raster.tile_version.assign(tiles_x_*tiles_y_, 0);
+        rasters_.publish();
+        shown_ = &rasters_.front();
+    }
+    // packed in the channel order the cells have always been drawn with
+    for(size_t a=0;a<num_colors;++a) {
+        auto channel = [](double v) { return static_cast<uint32_t>(v*255.0+0.5); };
+        palette_[a] = (channel(col_set[a].alpha) << 24) | (channel(col_set[a].red) << 16)
+            | (channel(col_set[a].blue) << 8) | channel(col_set[a].green);
+    }
 
-    draw_dispatcher_.connect([&]() {this->queue_draw();});
+    tick_id_ = add_tick_callback(sigc::mem_fun(*this, &Sim1942::on_tick));
 
     add_events(Gdk::POINTER_MOTION_MASK |
         Gdk::BUTTON_PRESS_MASK|Gdk::BUTTON_RELEASE_MASK |
@@ -59,15 +95,33 @@ Sim1942::Sim1942(int width, int height, double mu, int delay) :
     //     std::cerr << "    Hello World    \n";
     // });
 
+    render_thread_ = Glib::Threads::Thread::create([&]{
+        render_thread();
+    });
     worker_thread_ = Glib::Threads::Thread::create([&]{
-        worker_.do_work(this);
+        if(replay_) {
+            replay_->do_work([this]{ notify_render(); });
+        } else {
+            worker_.do_work([this]{ notify_render(); });
+        }
     });
 }
 
 Sim1942::~Sim1942()
 {
-    worker_.stop();
+    remove_tick_callback(tick_id_);
+    if(replay_) {
+        replay_->stop();
+    } else {
+        worker_.stop();
+    }
     worker_thread_->join();
+    {
+        std::lock_guard<std::mutex> lock{render_mutex_};
+        render_stop_ = true;
+        render_wake_.notify_one();
+    }
+    render_thread_->join();
 }
 
 void Sim1942::on_realize() {
@@ -143,6 +197,10 @@ void Sim1942::on_size_allocate(Gtk::Allocation& allocation) {
 
     // Icons
     update_iconbar_position();
+
+    // the note moves with the grid
+    note_text_.clear();
+    update_note();
 }
 
 void Sim1942::on_screen_changed(const Glib::RefPtr<Gdk::Screen>& previous_screen) {
@@ -154,27 +212,20 @@ bool Sim1942::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
 {
     //boost::timer::auto_cpu_timer measure_speed(std::cerr,  "on_draw: " "%ws wall, %us user + %ss system = %ts CPU (%p%)\n");
 
-    auto data = worker_.get_data();
-
+    // the render thread has done the conversion; this only composites
     cr->set_antialias(Cairo::ANTIALIAS_NONE);
     cr->save();
     cr->translate(west_,north_);
     cr->scale(cairo_scale_,cairo_scale_);
     cr->set_source_rgba(0.0,0.0,0.0,1.0);
     cr->paint();
-
-    for(int y=0;y<grid_height_;++y) {
-        for(int x=0;x<grid_width_;++x) {
-            int a = static_cast<int>(data.first[x+y*grid_width_].color());
-            assert(a < num_colors);
-            cr->set_source_rgba(
-                col_set[a].red, col_set[a].blue,
-                col_set[a].green, col_set[a].alpha
-            );
-            cr->rectangle(x,y,1.0,1.0);
-            cr->fill();
-        }
+    if(hex_) {
+        cr->scale(0.5,1.0);
     }
+    auto grid = Cairo::SurfacePattern::create(shown_->surface);
+    grid->set_filter(Cairo::FILTER_NEAREST);
+    cr->set_source(grid);
+    cr->paint();
     cr->restore();
 
     cr->set_antialias(Cairo::ANTIALIAS_GRAY);
@@ -190,15 +241,201 @@ bool Sim1942::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
         layout_icon_->show_in_cairo_context(cr);
     }
 
-    int text_x, text_y, text_width, text_height;
+    cr->move_to(pos_note_.first, pos_note_.second);
+    layout_note_->show_in_cairo_context(cr);
+
+    return true;
+}
+
+void Sim1942::notify_render() {
+    std::lock_guard<std::mutex> lock{render_mutex_};
+    render_pending_ = true;
+    render_wake_.notify_one();
+}
+
+// Converts published frames into rasters. The cells of dirty tiles are
+// converted into a private image; a raster handed back by the GUI thread
+// then gets every tile that changed since it was last written.
+void Sim1942::render_thread() {
+    std::vector<uint32_t> pixels(raster_width_*grid_height_, palette_[null_allele]);
+    std::vector<unsigned long long> tile_version(tiles_x_*tiles_y_, 0);
+    unsigned long long version = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock{render_mutex_};
+            while(!render_pending_ && !render_stop_) {
+                render_wake_.wait(lock);
+            }
+            if(render_stop_) {
+                return;
+            }
+            render_pending_ = false;
+        }
+        if(!(replay_ ? replay_->pending() : worker_.pending())) {
+            continue;
+        }
+        const snapshot_t &frame = replay_ ? replay_->latest() : worker_.latest();
+        version += 1;
+        for(int t=0;t<tiles_x_*tiles_y_;++t) {
+            if(!frame.dirty[t]) {
+                continue;
+            }
+            int x0 = (t % tiles_x_)*tile_size, y0 = (t / tiles_x_)*tile_size;
+            draw_cells(frame.colors, pixels.data(), x0, std::min(x0+tile_size, grid_width_),
+                y0, std::min(y0+tile_size, grid_height_));
+            tile_version[t] = version;
+        }
+
+        raster_t &raster = rasters_.back();
+        raster.surface->flush();
+        unsigned char *data = raster.surface->get_data();
+        const int stride = raster.surface->get_stride();
+        for(int t=0;t<tiles_x_*tiles_y_;++t) {
+            if(tile_version[t] <= raster.version) {
+                continue;
+            }
+            int x0 = (t % tiles_x_)*tile_size, y0 = (t / tiles_x_)*tile_size;
+            int x1 = std::min(x0+tile_size, grid_width_), y1 = std::min(y0+tile_size, grid_height_);
+            for(int y=y0;y<y1;++y) {
+                auto span = pixel_span(y, x0, x1);
+                std::copy(&pixels[y*raster_width_+span.first], &pixels[y*raster_width_+span.second],
+                    reinterpret_cast<uint32_t*>(data + y*stride) + span.first);
+            }
+        }
+        raster.surface->mark_dirty();
+        raster.generation = frame.generation;
+        raster.version = version;
+        raster.tile_version = tile_version;
+        rasters_.publish();
+    }
+}
+
+std::pair<int,int> Sim1942::pixel_span(int y, int x0, int x1) const {
+    if(!hex_) {
+        return {x0, x1};
+    }
+    // odd rows start with half a null cell and lose the last half cell
+    int shift = y & 1;
+    return {(x0 == 0) ? 0 : 2*x0+shift, std::min(2*x1+shift, raster_width_)};
+}
+
+void Sim1942::draw_cells(const colors_t &colors, uint32_t *pixels, int x0, int x1, int y0, int y1) const {
+    for(int y=y0;y<y1;++y) {
+        uint32_t *row = pixels + y*raster_width_;
+        const uint8_t *cells = &colors[y*grid_width_];
+        if(!hex_) {
+            for(int x=x0;x<x1;++x) {
+                row[x] = palette_[cells[x]];
+            }
+            continue;
+        }
+        int shift = y & 1;
+        if(x0 == 0) {
+            row[0] = palette_[null_allele];
+        }
+        for(int x=x0;x<x1;++x) {
+            row[2*x+shift] = palette_[cells[x]];
+            if(2*x+1+shift < raster_width_) {
+                row[2*x+1+shift] = palette_[cells[x]];
+            }
+        }
+    }
+}
+
+// Runs once per frame of the display, just before it is drawn, so whatever
+// the simulation produced since the last frame is presented exactly once.
+bool Sim1942::on_tick(const Glib::RefPtr<Gdk::FrameClock>& clock) {
+    update_frame();
+    if(generation_period_ > 0) {
+        gint64 now = clock->get_frame_time();
+        gint64 interval, presentation;
+        clock->get_refresh_info(now, interval, presentation);
+        // Release every generation on the frame nearest its due time. They
+        // are ready for the next frame, so the display keeps the rate even
+        // when it is faster than the refresh rate.
+        if(next_generation_ < now - interval) {
+            // do not try to catch up on frames that were never drawn
+            next_generation_ = now;
+        }
+        if(now + interval/2 >= next_generation_) {
+            gint64 due = (now + interval/2 - next_generation_)/generation_period_ + 1;
+            worker_.advance(due);
+            next_generation_ += due*generation_period_;
+        }
+    }
+    return true;
+}
+
+// Show the newest raster and queue the tiles that changed since the last
+// one, so a settled grid costs little more than the note.
+void Sim1942::update_frame() {
+    if(rasters_.pending()) {
+        shown_ = &rasters_.front();
+        generation_ = shown_->generation;
+        for(int ty=0;ty<tiles_y_;++ty) {
+            const unsigned long long *changed = &shown_->tile_version[ty*tiles_x_];
+            // a run of changed tiles is queued as one area
+            for(int tx=0;tx<tiles_x_;) {
+                if(changed[tx] <= shown_version_) {
+                    ++tx;
+                    continue;
+                }
+                int tx0 = tx;
+                while(tx < tiles_x_ && changed[tx] > shown_version_) {
+                    ++tx;
+                }
+                queue_draw_cells(tx0*tile_size, std::min(tx*tile_size, grid_width_),
+                    ty*tile_size, std::min((ty+1)*tile_size, grid_height_));
+            }
+        }
+        shown_version_ = shown_->version;
+    }
+    update_note();
+}
+
+void Sim1942::queue_draw_cells(int x0, int x1, int y0, int y1) {
+    // odd hex rows reach half a cell further right; the extra pixel on each
+    // side covers rounding
+    double right = x1 + (hex_ ? 0.5 : 0.0);
+    int left = static_cast<int>(std::floor(west_+x0*cairo_scale_)) - 1;
+    int top = static_cast<int>(std::floor(north_+y0*cairo_scale_)) - 1;
+    int width = static_cast<int>(std::ceil(west_+right*cairo_scale_)) + 1 - left;
+    int height = static_cast<int>(std::ceil(north_+y1*cairo_scale_)) + 1 - top;
+    queue_draw_area(left, top, width, height);
+}
+
+// Set the text of the note and, if it changed, queue the area it covered
+// and covers now.
+void Sim1942::update_note() {
+    if(!layout_note_) {
+        return;
+    }
     char msg[128];
-    snprintf(msg, 128, "Generation: %'llu", data.second);
+    if(replay_ && replay_->paused()) {
+        snprintf(msg, 128, "Replay paused: %'llu", generation_);
+    } else if(replay_) {
+        snprintf(msg, 128, "Replay at %g/s: %'llu", replay_->speed(), generation_);
+    } else {
+        snprintf(msg, 128, "Generation: %'llu", generation_);
+    }
+    if(note_text_ == msg) {
+        return;
+    }
+    note_text_ = msg;
+    int text_width, text_height;
     layout_note_->set_text(msg);
     layout_note_->get_pixel_size(text_width,text_height);
-    cr->move_to(east_-text_width-0.025*draw_width_,south_-text_height-0.025*draw_height_);
-    layout_note_->show_in_cairo_context(cr);
+    pos_note_ = {east_-text_width-0.025*draw_width_, south_-text_height-0.025*draw_height_};
 
-    return true;
+    Gdk::Rectangle box{static_cast<int>(pos_note_.first)-1, static_cast<int>(pos_note_.second)-1,
+        text_width+2, text_height+2};
+    if(note_box_.has_zero_area()) {
+        note_box_ = box;
+    } else {
+        note_box_.join(box);
+    }
+    queue_draw_area(note_box_.get_x(), note_box_.get_y(), note_box_.get_width(), note_box_.get_height());
+    note_box_ = box;
 }
 
 // bool Sim1942::on_event(GdkEvent* event) {
@@ -207,6 +444,9 @@ bool Sim1942::on_draw(const Cairo::RefPtr<Cairo::Context>& cr)
 // }
 
 bool Sim1942::on_key_press_event(GdkEventKey* key_event) {
+    if(replay_) {
+        return on_replay_key(key_event);
+    }
     if(key_event->keyval == GDK_KEY_F5 && show_iconbar_) {
         clear_clicked();
         return GDK_EVENT_STOP;
@@ -217,7 +457,59 @@ bool Sim1942::on_key_press_event(GdkEventKey* key_event) {
     return GDK_EVENT_PROPAGATE;
 }
 
+// Space pauses, Left and Right skip ten seconds of playback, Up and Down
+// double and halve the speed, minus reverses, Home and End go to the ends,
+// and a generation number followed by Return jumps to it.
+bool Sim1942::on_replay_key(GdkEventKey* key_event) {
+    double speed = replay_->speed();
+    switch(key_event->keyval) {
+    case GDK_KEY_space:
+        replay_->toggle_pause();
+        break;
+    case GDK_KEY_Left:
+        replay_->skip(-10.0*std::max(std::abs(speed), 1.0));
+        break;
+    case GDK_KEY_Right:
+        replay_->skip(10.0*std::max(std::abs(speed), 1.0));
+        break;
+    case GDK_KEY_Up:
+        replay_->set_speed(2.0*speed);
+        break;
+    case GDK_KEY_Down:
+        replay_->set_speed(0.5*speed);
+        break;
+    case GDK_KEY_minus:
+    case GDK_KEY_KP_Subtract:
+        replay_->set_speed(-speed);
+        break;
+    case GDK_KEY_Home:
+        replay_->jump(0);
+        break;
+    case GDK_KEY_End:
+        replay_->jump(ULLONG_MAX);
+        break;
+    case GDK_KEY_Return:
+    case GDK_KEY_KP_Enter:
+        if(!replay_jump_.empty()) {
+            replay_->jump(std::stoull(replay_jump_));
+            replay_jump_.clear();
+        }
+        break;
+    default:
+        if(GDK_KEY_0 <= key_event->keyval && key_event->keyval <= GDK_KEY_9
+            && replay_jump_.size() < 18) {
+            replay_jump_ += static_cast<char>('0' + (key_event->keyval - GDK_KEY_0));
+            break;
+        }
+        return GDK_EVENT_PROPAGATE;
+    }
+    return GDK_EVENT_STOP;
+}
+
 bool Sim1942::on_touch_event(GdkEventTouch* touch_event) {
+    if(replay_) {
+        return GDK_EVENT_PROPAGATE;
+    }
     if(!(touch_event->state & GDK_BUTTON1_MASK)) {
         return GDK_EVENT_PROPAGATE;
     }
@@ -231,7 +523,7 @@ bool Sim1942::on_touch_event(GdkEventTouch* touch_event) {
         if(process_iconbar_click(touch_event->x,touch_event->y)) {
             return GDK_EVENT_STOP;
         }
-        show_iconbar_ = true;
+        show_iconbar();
         touch_lastxy_[touch_event->sequence] = {x,y};
         worker_.toggle_cell(x,y,!erasing_);
         }
@@ -262,7 +554,7 @@ bool Sim1942::on_touch_event(GdkEventTouch* touch_event) {
 
 bool Sim1942::on_button_press_event(GdkEventButton* button_event) {
     update_cursor_timeout();
-    if(button_event->button != GDK_BUTTON_PRIMARY) {
+    if(replay_ || button_event->button != GDK_BUTTON_PRIMARY) {
         return GDK_EVENT_PROPAGATE;
     }
     int x = button_event->x;
@@ -273,7 +565,7 @@ bool Sim1942::on_button_press_event(GdkEventButton* button_event) {
         return GDK_EVENT_STOP;
     }
     if(ret) {
-        show_iconbar_ = true;
+        show_iconbar();
         worker_.toggle_cell(x,y,!erasing_);
     }
     return GDK_EVENT_STOP;
@@ -285,7 +577,7 @@ bool Sim1942::on_motion_notify_event(GdkEventMotion* motion_event) {
         return GDK_EVENT_PROPAGATE;
     }
     update_cursor_timeout();
-    if(!(motion_event->state & GDK_BUTTON1_MASK)) {
+    if(replay_ || !(motion_event->state & GDK_BUTTON1_MASK)) {
         return GDK_EVENT_PROPAGATE;
     }
     int x = motion_event->x;
@@ -336,14 +628,19 @@ void Sim1942::update_cursor_timeout() {
 
 bool Sim1942::device_to_cell(int *x, int *y) {
     bool ret = true;
-    if( x != nullptr ) {
-        *x = (*x-west_)/cairo_scale_;
-        ret = ret && 0 <= x < grid_width_;
-    }
     if( y != nullptr ) {
         *y = (*y-north_)/cairo_scale_;
         ret = ret && 0 <= y < grid_height_;
     }
+    if( x != nullptr ) {
+        double cx = (*x-west_)/cairo_scale_;
+        if(hex_ && y != nullptr && (*y & 1)) {
+            // odd rows of the hex lattice are drawn half a cell to the right
+            cx -= 0.5;
+        }
+        *x = cx;
+        ret = ret && 0 <= x < grid_width_;
+    }
     return ret;
 }
 
@@ -361,6 +658,7 @@ void Sim1942::clear_clicked() {
         eraser_clicked();
     }
     show_iconbar_ = false;
+    queue_draw_iconbar();
     worker_.do_clear_nulls();
 }
 
@@ -371,8 +669,27 @@ void Sim1942::set_iconbar_markup(const char *ss) {
     update_iconbar_position();
 }
 
+void Sim1942::show_iconbar() {
+    if(!show_iconbar_) {
+        show_iconbar_ = true;
+        queue_draw_iconbar();
+    }
+}
+
+// Only changed tiles of the grid are redrawn, so the icon bar has to queue
+// its own area whenever it appears, disappears, moves or changes.
+void Sim1942::queue_draw_iconbar() {
+    if(!box_iconbar_) {
+        return;
+    }
+    auto box = box_iconbar_->get_extents();
+    queue_draw_area(box.x-1, box.y-1, box.width+2, box.height+2);
+}
+
+// Place the icon bar and queue the area it covered and covers now.
 void Sim1942::update_iconbar_position() {
     assert(layout_icon_);
+    queue_draw_iconbar();
 
     int text_width, text_height;
     layout_icon_->get_pixel_size(text_width,text_height);
@@ -382,10 +699,7 @@ void Sim1942::update_iconbar_position() {
         static_cast<int>(pos_icon_.first),
         static_cast<int>(pos_icon_.second),
         text_width, text_height});
-}
-
-void Sim1942::notify_queue_draw() {
-    draw_dispatcher_.emit();
+    queue_draw_iconbar();
 }
 
 void Sim1942::create_our_pango_layouts() {
@@ -1,9 +1,11 @@
 #ifndef CARTWRIGHT_SIM1942_H
 #define CARTWRIGHT_SIM1942_H
 
+#include <gtkmm.h>
 #include <gtkmm/drawingarea.h>
 
 #include "worker.h"
+#include "replay.h"
 #include <boost/timer/timer.hpp>
 
 #include <tuple>
@@ -11,7 +13,9 @@
 class Sim1942 : public Gtk::DrawingArea
 {
 public:
-    Sim1942(int width, int height, double mu, int delay);
+    Sim1942(int width, int height, double mu, int delay, const worker_arg_t &opt);
+    // Play back a recording instead of running a simulation.
+    explicit Sim1942(std::unique_ptr<Replay> replay);
     virtual ~Sim1942();
 
     void name(const char* n) {
@@ -24,11 +28,33 @@ public:
        worker_.toggle_cells(barriers, true); 
     }
 
-    void notify_queue_draw();
-
 protected:
     bool device_to_cell(int *x, int *y);
     bool process_iconbar_click(int x, int y);
+    bool on_replay_key(GdkEventKey* key_event);
+    void init();
+
+    // A grid converted to pixels by the render thread.
+    struct raster_t {
+        Cairo::RefPtr<Cairo::ImageSurface> surface;
+        unsigned long long generation{0};
+        // the render thread's frame count when this raster was written, and
+        // when each of its tiles last changed
+        unsigned long long version{0};
+        std::vector<unsigned long long> tile_version;
+    };
+
+    // Wake the render thread; called by the simulation thread.
+    void notify_render();
+    void render_thread();
+    // The pixels [first,second) of row y that show cells [x0,x1).
+    std::pair<int,int> pixel_span(int y, int x0, int x1) const;
+    void draw_cells(const colors_t &colors, uint32_t *pixels, int x0, int x1, int y0, int y1) const;
+
+    bool on_tick(const Glib::RefPtr<Gdk::FrameClock>& clock);
+    void update_frame();
+    void queue_draw_cells(int x0, int x1, int y0, int y1);
+    void update_note();
 
     void create_our_pango_layouts();
 
@@ -36,6 +62,8 @@ protected:
     void clear_clicked();
     void set_iconbar_markup(const char *ss);
     void update_iconbar_position();
+    void show_iconbar();
+    void queue_draw_iconbar();
 
     void update_cursor_timeout();
 
@@ -56,13 +84,35 @@ protected:
     int device_width_, device_height_;
     int grid_width_, grid_height_;
     double mu_;
+    bool hex_;
 
     std::string name_{"Human and Comparative Genomics Laboratory"};
 
-    double cairo_scale_;
-
-    double draw_width_, draw_height_;
-    double east_, north_, west_, south_;
+    double cairo_scale_{0.0};
+
+    // The grid is converted into images of one pixel per cell, or two
+    // across in hex mode, which on_draw scales onto the window in a single
+    // paint.
+    int raster_width_;
+    int tiles_x_, tiles_y_;
+    std::array<uint32_t,num_colors> palette_;
+    triple_buffer<raster_t> rasters_;
+    // the raster on screen, owned by the GUI thread until the next one
+    const raster_t *shown_{nullptr};
+    unsigned long long shown_version_{0};
+    // the generation of the shown raster and the area of the note showing it
+    unsigned long long generation_{0};
+    std::string note_text_;
+    Gdk::Rectangle note_box_;
+
+    guint tick_id_{0};
+    // microseconds of frame time between generations, or 0 if the worker
+    // paces itself, and when the next one is due
+    gint64 generation_period_{0};
+    gint64 next_generation_{0};
+
+    double draw_width_{0.0}, draw_height_{0.0};
+    double east_{0.0}, north_{0.0}, west_{0.0}, south_{0.0};
 
  
     Glib::RefPtr<Gdk::Pixbuf> logo_;
@@ -80,8 +130,14 @@ protected:
 
     Worker worker_;
     Glib::Threads::Thread* worker_thread_{nullptr};
+    Glib::Threads::Thread* render_thread_{nullptr};
+    std::mutex render_mutex_;
+    std::condition_variable render_wake_;
+    bool render_pending_{false}, render_stop_{false};
+    // set in replay mode, where it replaces the worker
+    std::unique_ptr<Replay> replay_;
+    std::string replay_jump_;
 
-    Glib::Dispatcher draw_dispatcher_;
 
     typedef GdkEventSequence* gdk_event_sequence_t;
     typedef std::map<gdk_event_sequence_t,std::pair<int,int>> touch_lastxy_t;  
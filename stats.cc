@@ -0,0 +1,138 @@
+#include "stats.h"
+
+#include <cmath>
+#include <iostream>
+
+stats_pipeline::stats_pipeline(const std::string &name, double interval) :
+    interval_{std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval))}
+{
+    out_ = std::fopen(name.c_str(), "w");
+    if(out_ == nullptr) {
+        return;
+    }
+    std::fputs("generation,skipped,alleles,simpson,shannon,mean_fitness,max_fitness", out_);
+    for(size_t a=0;a<num_alleles;++a) {
+        std::fprintf(out_, ",count%zu", a);
+    }
+    std::fputc('\n', out_);
+    thread_ = std::thread([this]{ stats_thread(); });
+}
+
+stats_pipeline::~stats_pipeline() {
+    if(out_ == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_ = true;
+        ready_.notify_one();
+    }
+    thread_.join();
+    bool ok = !std::ferror(out_);
+    if(std::fclose(out_) != 0 || !ok) {
+        std::cerr << "Unable to write the statistics." << std::endl;
+    }
+    if(total_skipped_ > 0) {
+        std::cout << "Statistics skipped " << total_skipped_
+                  << " generation(s) to keep up.\n";
+    }
+}
+
+void stats_pipeline::offer(unsigned long long generation, const pop_t &pop) {
+    if(out_ == nullptr) {
+        return;
+    }
+    // decimated generations are skipped too, but not for falling behind
+    auto now = clock::now();
+    if(now < next_offer_) {
+        skipped_ += 1;
+        return;
+    }
+    // never wait for the stats thread
+    std::unique_lock<std::mutex> lock{mutex_, std::try_to_lock};
+    if(!lock.owns_lock() || pending_) {
+        skipped_ += 1;
+        total_skipped_ += 1;
+        return;
+    }
+    next_offer_ = now + interval_;
+    generation_ = generation;
+    generation_skipped_ = skipped_;
+    skipped_ = 0;
+    pop.get_colors(&color_);
+    fitness_.resize(pop.width*pop.height);
+    for(int y=0;y<pop.height;++y) {
+        std::copy_n(pop.fitness.begin()+pop.index(0,y), pop.width,
+            fitness_.begin()+y*pop.width);
+    }
+    pending_ = true;
+    ready_.notify_one();
+}
+
+void stats_pipeline::stats_thread() {
+    for(;;) {
+        generation_stats stats;
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            while(!pending_ && !stop_) {
+                ready_.wait(lock);
+            }
+            if(!pending_) {
+                return;
+            }
+            // take the grid and leave the buffers of the last one for offer
+            std::swap(color_, work_color_);
+            std::swap(fitness_, work_fitness_);
+            stats.generation = generation_;
+            stats.skipped = generation_skipped_;
+            pending_ = false;
+        }
+        summarize(&stats);
+        write(stats);
+    }
+}
+
+void stats_pipeline::summarize(generation_stats *stats) const {
+    stats->counts.fill(0);
+    double total = 0.0;
+    double max = 0.0;
+    for(size_t i=0;i<work_color_.size();++i) {
+        uint8_t c = work_color_[i];
+        stats->counts[c] += 1;
+        if(c < num_alleles) {
+            total += work_fitness_[i];
+            max = std::max(max, work_fitness_[i]);
+        }
+    }
+    int living = 0;
+    for(size_t a=0;a<num_alleles;++a) {
+        living += stats->counts[a];
+    }
+    if(living == 0) {
+        return;
+    }
+    double sum_p2 = 0.0;
+    double entropy = 0.0;
+    for(size_t a=0;a<num_alleles;++a) {
+        if(stats->counts[a] == 0) {
+            continue;
+        }
+        double p = static_cast<double>(stats->counts[a])/living;
+        stats->alleles += 1;
+        sum_p2 += p*p;
+        entropy -= p*std::log(p);
+    }
+    stats->simpson = 1.0-sum_p2;
+    stats->shannon = entropy;
+    stats->mean_fitness = total/living;
+    stats->max_fitness = max;
+}
+
+void stats_pipeline::write(const generation_stats &stats) {
+    std::fprintf(out_, "%llu,%llu,%d,%.6f,%.6f,%.6g,%.6g", stats.generation, stats.skipped,
+        stats.alleles, stats.simpson, stats.shannon, stats.mean_fitness, stats.max_fitness);
+    for(size_t a=0;a<num_alleles;++a) {
+        std::fprintf(out_, ",%d", stats.counts[a]);
+    }
+    std::fputc('\n', out_);
+}
@@ -0,0 +1,81 @@
+#ifndef CARTWRIGHT_STATS_H
+#define CARTWRIGHT_STATS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "worker.h"
+
+// Summary of one generation.
+struct generation_stats {
+    unsigned long long generation{0};
+    // generations skipped since the previous summary
+    unsigned long long skipped{0};
+    color_count_t counts;
+    int alleles{0};
+    // Gini-Simpson (1 - sum p^2) and Shannon (-sum p ln p) diversity of the
+    // allele frequencies among living cells
+    double simpson{0.0};
+    double shannon{0.0};
+    double mean_fitness{0.0};
+    double max_fitness{0.0};
+};
+
+// Computes statistics of published generations on its own thread and
+// writes them as CSV, one row per generation. The generation loop never
+// waits: a generation offered while the previous one is still being
+// summarized, or sooner than interval seconds after the last one taken, is
+// skipped, and the next row records how many were.
+class stats_pipeline {
+public:
+    stats_pipeline(const std::string &name, double interval);
+    ~stats_pipeline();
+
+    bool is_open() const {
+        return out_ != nullptr;
+    }
+
+    // Copy the grid of pop for the stats thread, or skip it if the thread
+    // is busy or the interval has not passed. Only the thread that runs
+    // the generations may call this.
+    void offer(unsigned long long generation, const pop_t &pop);
+
+private:
+    void stats_thread();
+    void summarize(generation_stats *stats) const;
+    void write(const generation_stats &stats);
+
+    typedef std::chrono::steady_clock clock;
+
+    FILE *out_{nullptr};
+    // the copy costs the generation loop about 9 bytes per cell, so it is
+    // made no more often than this
+    clock::duration interval_;
+    clock::time_point next_offer_;
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    bool pending_{false};
+    bool stop_{false};
+    std::thread thread_;
+
+    // the grid waiting to be summarized, filled by offer
+    unsigned long long generation_{0};
+    unsigned long long generation_skipped_{0};
+    colors_t color_;
+    std::vector<double> fitness_;
+
+    // owned by the thread that offers
+    unsigned long long skipped_{0};
+    unsigned long long total_skipped_{0};
+
+    // the grid being summarized, owned by the stats thread
+    colors_t work_color_;
+    std::vector<double> work_fitness_;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef CARTWRIGHT_TRIPLE_BUFFER_H
+#define CARTWRIGHT_TRIPLE_BUFFER_H
+
+#include <array>
+#include <atomic>
+
+// Hands values from one writer thread to one reader thread without locks.
+// The writer fills back() and publishes it with a single atomic exchange;
+// the reader swaps in the newest published value the same way. Neither
+// side ever waits or copies, and values the reader never got to are
+// simply overwritten.
+template<typename T>
+class triple_buffer {
+public:
+    // Writer side: the slot to fill next.
+    T& back() {
+        return slots_[back_];
+    }
+    // Writer side: make back() the newest value and get a free slot.
+    void publish() {
+        back_ = middle_.exchange(back_ | fresh, std::memory_order_acq_rel) & index;
+    }
+
+    // Whether a value was published that the reader has not taken yet.
+    // Either side may ask, but the answer can change right after.
+    bool pending() const {
+        return middle_.load(std::memory_order_acquire) & fresh;
+    }
+
+    // Reader side: the newest published value. It stays valid, and
+    // unchanged, until the next call.
+    const T& front() {
+        if(middle_.load(std::memory_order_relaxed) & fresh) {
+            front_ = middle_.exchange(front_, std::memory_order_acq_rel) & index;
+        }
+        return slots_[front_];
+    }
+
+private:
+    // middle_ holds a slot index and whether it was published since the
+    // reader last took it
+    static constexpr unsigned index = 3, fresh = 4;
+
+    std::array<T,3> slots_;
+    unsigned back_{0};
+    unsigned front_{1};
+    std::atomic<unsigned> middle_{2};
+};
+
+#endif
@@ -1,25 +1,108 @@
 #include "worker.h"
-#include "sim1942.h"
 #include "rexp.h"
+#include "kernel.h"
+#include "dispersal.h"
+#include "checkpoint.h"
+#include "recording.h"
+#include "stats.h"
 
-#include <glibmm/timer.h>
+#include <unistd.h>
+
+#include <boost/filesystem.hpp>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
 #include <cassert>
 #include <array>
 
-Worker::Worker(int width, int height, double mu,int delay) :
-  grid_width_{width}, grid_height_{height}, mu_{mu},
-  pop_a_{new pop_t(width*height)},
-  pop_b_{new pop_t(width*height)},
+Worker::Worker(int width, int height, double mu, int delay, const worker_arg_t &opt) :
+  grid_width_{width}, grid_height_{height}, mu_{mu}, gen_{0},
+  delay_{delay},
+  pop_a_{new pop_t(width,height)},
+  pop_b_{new pop_t(width,height)},
   rand{create_random_seed()},
-  delay_{delay}
+  frames_{width,height}
 {
+    kernel_ = opt.kernel;
+    engine_ = opt.engine;
+    neighborhood_ = opt.neighborhood;
+    boundary_ = opt.boundary;
+    if(opt.dispersal != dispersal_t::none) {
+        int candidates = (neighborhood_ == neighborhood_t::moore) ? moore::size :
+                         (neighborhood_ == neighborhood_t::hex) ? hex::size : von_neumann::size;
+        dispersal_.reset(new dispersal_kernel(opt.dispersal, opt.dispersal_radius,
+            opt.jump_rate, candidates, boundary_, width, height));
+    }
+    rate_ = opt.rate;
+    seed_ = opt.seed;
+    opt_ = opt;
+    opt_.resume.reset();
+    if(kernel_ == kernel_t::automatic) {
+        kernel_ = kernel_available(kernel_t::avx512) ? kernel_t::avx512 :
+                  kernel_available(kernel_t::avx2) ? kernel_t::avx2 : kernel_t::scalar;
+    } else if(!kernel_available(kernel_)) {
+        kernel_ = kernel_t::scalar;
+    }
+    int threads = opt.threads;
+    if(threads <= 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    num_bands_ = std::min(threads, height);
+    // seed the stream of each band from the main generator
+    for(int i=0;i<num_bands_;++i) {
+        uint64_t seed1 = rand.get_uint64();
+        uint64_t seed2 = rand.get_uint64();
+        band_rand_.emplace_back(seed1,seed2);
+        band_lanes_.emplace_back();
+        band_lanes_.back().seed(rand.get_uint64(), rand.get_uint64());
+    }
+    // the main stream only drives mutation, so a seeded run must not let
+    // the number of bands change it
+    if(seed_ != 0) {
+        rand.seed(seed_);
+    }
+    band_count_.resize(num_bands_);
+    spans_.resize(height);
+    for(int y=0;y<height;++y) {
+        update_spans(y);
+    }
+    if(opt.resume) {
+        restore(*opt.resume);
+    }
+    if(!opt.record.empty()) {
+        recorder_.reset(new recorder(opt.record, width, height, neighborhood_,
+            opt.record_keyframes));
+        if(!recorder_->is_open()) {
+            std::cerr << "Unable to open recording \"" << opt.record << "\"." << std::endl;
+            recorder_.reset();
+        }
+    }
+    stats_every_ = std::max(opt.stats_every, 1);
+    if(!opt.stats.empty()) {
+        stats_.reset(new stats_pipeline(opt.stats, opt.stats_interval));
+        if(!stats_->is_open()) {
+            std::cerr << "Unable to open statistics file \"" << opt.stats << "\"." << std::endl;
+            stats_.reset();
+        }
+    }
+    // something to draw before the first generation
+    publish();
+}
 
+Worker::~Worker() {
+    if(checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
 }
 
 void Worker::stop() {
+    std::lock_guard<std::mutex> lock{sync_mutex_};
     go_ = false;
-    do_next_generation();
+    sync_.notify_one();
 }
 
 const double mutation[128] = {
@@ -33,143 +116,611 @@ const double mutation[128] = {
   1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0
 };
 
-void Worker::do_work(Sim1942* caller)
+bool kernel_from_name(const std::string &name, kernel_t *kernel) {
+    for(kernel_t k : {kernel_t::automatic, kernel_t::scalar, kernel_t::avx2, kernel_t::avx512}) {
+        if(name == kernel_name(k)) {
+            *kernel = k;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* kernel_name(kernel_t kernel) {
+    switch(kernel) {
+    case kernel_t::automatic: return "auto";
+    case kernel_t::scalar: return "scalar";
+    case kernel_t::avx2: return "avx2";
+    case kernel_t::avx512: return "avx512";
+    }
+    return "";
+}
+
+bool engine_from_name(const std::string &name, engine_t *engine) {
+    for(engine_t e : {engine_t::race, engine_t::draw}) {
+        if(name == engine_name(e)) {
+            *engine = e;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* engine_name(engine_t engine) {
+    switch(engine) {
+    case engine_t::race: return "race";
+    case engine_t::draw: return "draw";
+    }
+    return "";
+}
+
+bool neighborhood_from_name(const std::string &name, neighborhood_t *neighborhood) {
+    for(neighborhood_t n : {neighborhood_t::von_neumann, neighborhood_t::moore, neighborhood_t::hex}) {
+        if(name == neighborhood_name(n)) {
+            *neighborhood = n;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* neighborhood_name(neighborhood_t neighborhood) {
+    switch(neighborhood) {
+    case neighborhood_t::von_neumann: return "von-neumann";
+    case neighborhood_t::moore: return "moore";
+    case neighborhood_t::hex: return "hex";
+    }
+    return "";
+}
+
+bool dispersal_from_name(const std::string &name, dispersal_t *dispersal) {
+    for(dispersal_t d : {dispersal_t::none, dispersal_t::gaussian, dispersal_t::exponential}) {
+        if(name == dispersal_name(d)) {
+            *dispersal = d;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* dispersal_name(dispersal_t dispersal) {
+    switch(dispersal) {
+    case dispersal_t::none: return "none";
+    case dispersal_t::gaussian: return "gaussian";
+    case dispersal_t::exponential: return "exponential";
+    }
+    return "";
+}
+
+bool boundary_from_name(const std::string &name, boundary_t *boundary) {
+    for(boundary_t b : {boundary_t::absorbing, boundary_t::torus, boundary_t::reflect}) {
+        if(name == boundary_name(b)) {
+            *boundary = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* boundary_name(boundary_t boundary) {
+    switch(boundary) {
+    case boundary_t::absorbing: return "absorbing";
+    case boundary_t::torus: return "torus";
+    case boundary_t::reflect: return "reflect";
+    }
+    return "";
+}
+
+bool make_worker_arg(worker_options_t *options, worker_arg_t *arg) {
+    worker_options_t &opt = *options;
+    if(opt.width <= 0 || opt.height <= 0 || opt.mu <= 0.0 || opt.threads < 0) {
+        std::cerr << "Invalid command line arguments." << std::endl;
+        return false;
+    }
+    arg->threads = opt.threads;
+    arg->seed = opt.seed;
+    if(!kernel_from_name(opt.kernel, &arg->kernel)) {
+        std::cerr << "Unknown kernel \"" << opt.kernel << "\"." << std::endl;
+        return false;
+    }
+    if(!kernel_available(arg->kernel)) {
+        std::cerr << "The " << opt.kernel << " kernel is not supported on this machine." << std::endl;
+        return false;
+    }
+    if(!engine_from_name(opt.engine, &arg->engine)) {
+        std::cerr << "Unknown engine \"" << opt.engine << "\"." << std::endl;
+        return false;
+    }
+    if(!neighborhood_from_name(opt.neighborhood, &arg->neighborhood)) {
+        std::cerr << "Unknown neighborhood \"" << opt.neighborhood << "\"." << std::endl;
+        return false;
+    }
+    if(!boundary_from_name(opt.boundary, &arg->boundary)) {
+        std::cerr << "Unknown boundary \"" << opt.boundary << "\"." << std::endl;
+        return false;
+    }
+    if(!dispersal_from_name(opt.dispersal, &arg->dispersal)) {
+        std::cerr << "Unknown dispersal kernel \"" << opt.dispersal << "\"." << std::endl;
+        return false;
+    }
+    if(opt.dispersal_radius <= 0.0 || opt.jump_rate < 0.0 || opt.jump_rate > 1.0) {
+        std::cerr << "Invalid dispersal parameters." << std::endl;
+        return false;
+    }
+    arg->dispersal_radius = opt.dispersal_radius;
+    arg->jump_rate = opt.jump_rate;
+    if(arg->neighborhood == neighborhood_t::hex && arg->boundary == boundary_t::torus
+        && opt.height % 2 != 0) {
+        std::cerr << "A hex lattice can only wrap around a torus with an even height." << std::endl;
+        return false;
+    }
+    if(opt.checkpoint_interval <= 0.0 || (opt.resume && opt.checkpoint.empty())) {
+        std::cerr << "Invalid checkpoint options." << std::endl;
+        return false;
+    }
+    arg->checkpoint = opt.checkpoint;
+    arg->checkpoint_interval = opt.checkpoint_interval;
+    if(opt.record_keyframes <= 0) {
+        std::cerr << "Invalid recording options." << std::endl;
+        return false;
+    }
+    arg->record = opt.record;
+    arg->record_keyframes = opt.record_keyframes;
+    if(opt.stats_every <= 0 || opt.stats_interval < 0.0) {
+        std::cerr << "Invalid statistics options." << std::endl;
+        return false;
+    }
+    arg->stats = opt.stats;
+    arg->stats_every = opt.stats_every;
+    arg->stats_interval = opt.stats_interval;
+    if(opt.resume && boost::filesystem::exists(opt.checkpoint)) {
+        // the saved run overrides the model given on the command line
+        auto ck = std::make_shared<checkpoint_t>();
+        if(load_checkpoint(opt.checkpoint, ck.get())) {
+            std::cout << "Resuming from \"" << opt.checkpoint << "\" at generation "
+                      << ck->generation << ".\n";
+            opt.width = ck->width;
+            opt.height = ck->height;
+            opt.mu = ck->mu;
+            apply_checkpoint_args(*ck, arg);
+            arg->resume = ck;
+        } else {
+            std::cerr << "Unable to read checkpoint \"" << opt.checkpoint
+                      << "\"; starting a new run." << std::endl;
+        }
+    }
+    // after resuming, as a checkpoint brings its own grid and kernel
+    if(arg->dispersal != dispersal_t::none && !dispersal_kernel::fits(arg->dispersal,
+        arg->dispersal_radius, arg->boundary, opt.width, opt.height)) {
+        std::cerr << "The dispersal radius is too large for a " << opt.width << "x"
+                  << opt.height << " grid." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void pop_t::fill_border(boundary_t boundary) {
+    if(boundary == boundary_t::absorbing) {
+        // the border keeps the null cells it was created with
+        return;
+    }
+    bool torus = (boundary == boundary_t::torus);
+    auto copy = [this](size_t to, size_t from) {
+        color[to] = color[from];
+        fitness[to] = fitness[from];
+    };
+    for(int y=0;y<height;++y) {
+        copy(index(-1,y), index(torus ? width-1 : 0, y));
+        copy(index(width,y), index(torus ? 0 : width-1, y));
+    }
+    // whole rows, so the corners come from the columns filled above
+    auto copy_row = [&](int to, int from) {
+        std::copy_n(color.begin()+index(-1,from), stride, color.begin()+index(-1,to));
+        std::copy_n(fitness.begin()+index(-1,from), stride, fitness.begin()+index(-1,to));
+    };
+    copy_row(-1, torus ? height-1 : 0);
+    copy_row(height, torus ? 0 : height-1);
+}
+
+void Worker::update_rows(int y0, int y1, xorshift64 &rand, xorshift64x8 &lanes,
+    color_count_t &color_count)
 {
+    const pop_t &a = *pop_a_.get();
+    pop_t &b = *pop_b_.get();
+    if(seed_ != 0) {
+        if(dispersal_) {
+            dispersal_->update_rows(a, b, spans_.data(), y0, y1, seed_, gen_, color_count);
+            return;
+        }
+        switch(kernel_) {
+        case kernel_t::avx512:
+            update_rows_seeded_avx512(a, b, spans_.data(), y0, y1, seed_, gen_, color_count,
+                engine_, neighborhood_);
+            break;
+        case kernel_t::avx2:
+            update_rows_seeded_avx2(a, b, spans_.data(), y0, y1, seed_, gen_, color_count,
+                engine_, neighborhood_);
+            break;
+        default:
+            update_rows_seeded(a, b, spans_.data(), y0, y1, seed_, gen_, color_count,
+                engine_, neighborhood_);
+            break;
+        }
+        return;
+    }
+    if(dispersal_) {
+        dispersal_->update_rows(a, b, spans_.data(), y0, y1, rand, color_count);
+        return;
+    }
+    switch(kernel_) {
+    case kernel_t::avx512:
+        update_rows_avx512(a, b, spans_.data(), y0, y1, rand, lanes, color_count, engine_, neighborhood_);
+        break;
+    case kernel_t::avx2:
+        update_rows_avx2(a, b, spans_.data(), y0, y1, rand, lanes, color_count, engine_, neighborhood_);
+        break;
+    default:
+        update_rows_scalar(a, b, spans_.data(), y0, y1, rand, color_count, engine_, neighborhood_);
+        break;
+    }
+}
+
+void Worker::update_band(int band) {
+    int y0 = (band*grid_height_)/num_bands_;
+    int y1 = ((band+1)*grid_height_)/num_bands_;
+    band_count_[band].fill(0);
+    update_rows(y0, y1, band_rand_[band], band_lanes_[band], band_count_[band]);
+}
+
+void Worker::band_thread(int band) {
+    unsigned long long round = 0;
+    for(;;) {
+        {
+            std::unique_lock<std::mutex> lock{band_mutex_};
+            while(band_round_ == round) {
+                band_start_.wait(lock);
+            }
+            round = band_round_;
+            if(!band_go_) {
+                return;
+            }
+        }
+        update_band(band);
+        std::lock_guard<std::mutex> lock{band_mutex_};
+        if(--bands_pending_ == 0) {
+            band_done_.notify_one();
+        }
+    }
+}
+
+void Worker::run_bands() {
+    {
+        std::lock_guard<std::mutex> lock{band_mutex_};
+        bands_pending_ = num_bands_-1;
+        band_round_ += 1;
+        band_start_.notify_all();
+    }
+    // the calling thread does the first band itself
+    update_band(0);
+    std::unique_lock<std::mutex> lock{band_mutex_};
+    while(bands_pending_ > 0) {
+        band_done_.wait(lock);
+    }
+}
+
+void Worker::start_bands() {
     static_assert(num_alleles < 256, "Too many colors.");
+    if(dispersal_) {
+        std::cout << "Running the dispersal kernel with " << dispersal_->candidates()
+                  << " parents per cell on " << num_bands_ << " thread(s) with "
+                  << boundary_name(boundary_) << " edges.\n";
+    } else {
+        std::cout << "Running the " << kernel_name(kernel_) << " " << engine_name(engine_)
+                  << " kernel on " << num_bands_ << " thread(s) with a "
+                  << neighborhood_name(neighborhood_) << " neighborhood and "
+                  << boundary_name(boundary_) << " edges.\n";
+    }
+    if(seed_ != 0) {
+        std::cout << "Using seed " << seed_ << ".\n";
+    }
+    band_go_ = true;
+    for(int band=1;band<num_bands_;++band) {
+        band_threads_.emplace_back([this,band]{
+            band_thread(band);
+        });
+    }
+    // barriers loaded before the start apply to the first generation
+    apply_toggles();
+    pop_a_->fill_border(boundary_);
+    publish();
+    if(recorder_) {
+        recorder_->push(gen_, *pop_a_);
+    }
+    if(stats_ && gen_ % stats_every_ == 0) {
+        stats_->offer(gen_, *pop_a_);
+    }
+}
+
+void Worker::stop_bands() {
+    {
+        std::lock_guard<std::mutex> lock{band_mutex_};
+        band_go_ = false;
+        band_round_ += 1;
+        band_start_.notify_all();
+    }
+    for(auto && thread : band_threads_) {
+        thread.join();
+    }
+    band_threads_.clear();
+}
+
+void Worker::step() {
+    //boost::timer::auto_cpu_timer measure_speed(std::cerr,  "do_work: " "%ws wall, %us user + %ss system = %ts CPU (%p%)\n");
+
+    pop_t &b = *pop_b_.get();
+    run_bands();
+    // merge the census of every band
+    color_count_.fill(0);
+    for(auto && count : band_count_) {
+        for(size_t color = 0; color < num_colors; ++color) {
+            color_count_[color] += count[color];
+        }
+    }
+    // Do Mutation
+    int pos  = static_cast<int>(floor(rand_exp(rand,mu_)));
+    if(pos < grid_width_*grid_height_) {
+        // Setup colors since will will have to do at least one mutation
+        empty_colors_.clear();
+        for(size_t color = 0; color < num_alleles; ++color) {
+            if(color_count_[color] == 0) 
+                empty_colors_.emplace_back(color);
+        }
+    }
+    while(pos < grid_width_*grid_height_) {
+        // save pos
+        int opos = b.index(pos % grid_width_, pos / grid_width_);
+        pos += static_cast<int>(floor(rand_exp(rand,mu_)));
+        if(!b.is_fertile(opos))
+            continue;
+        // mutate
+        uint64_t r = rand.get_uint64();
+        static_assert(sizeof(mutation)/sizeof(double) == 128, "number of possible mutations is not 128");
+        b.fitness[opos] *= mutation[r >> 57]; // use top 7 bits for phenotype
+        r &= 0x01FFFFFFFFFFFFFF;
+        uint64_t color;
+        if(empty_colors_.empty()) {
+            // Get the color of the parent
+            color = b.color[opos];
+            // Mutate color so that it does not match the parent
+            color = (color + r % (num_alleles-1)) % num_alleles;
+        } else {
+            // retrieve random empty color and erase it
+            int col = r % empty_colors_.size();
+            color = empty_colors_[col];
+            if(pos < grid_width_*grid_height_)
+                empty_colors_.erase(empty_colors_.begin()+col);                
+        }
+        b.color[opos] = static_cast<uint8_t>(color);
+    }
+
+    // Every so often rescale fitnesses to prevent underflow/overflow
+    if((1+gen_) % 10000 == 0) {
+        double m = *std::max_element(b.fitness.begin(),b.fitness.end());
+        if(m > 1e6) {
+            for(auto &f : b.fitness) {
+                f = f/m + (DBL_EPSILON/2.0);
+            }
+        }
+    }
+    swap_buffers();
+}
+
+void Worker::do_work(std::function<void()> on_generation)
+{
+    typedef std::chrono::steady_clock clock;
     go_ = true;
-    next_generation_ = false;
-    gen_ = 0;
     sleep(delay_);
+    start_bands();
 
-    std::array<int,num_colors> color_count; 
-    std::vector<int> empty_colors(num_colors);
+    // Uncapped runs report once a second instead of every generation.
+    const auto period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(rate_ > 0.0 ? 1.0/rate_ : 0.0));
+    const auto report_period = (rate_ > 0.0) ? clock::duration::zero() : std::chrono::seconds(1);
+    auto next = clock::now();
+    auto next_report = next;
+    const auto checkpoint_period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(opt_.checkpoint_interval));
+    auto next_checkpoint = next + checkpoint_period;
+    // an externally paced worker waits this long for a release before it
+    // falls back on its own clock
+    const auto stall = std::max<clock::duration>(2*period, std::chrono::milliseconds(250));
+    bool own_clock = !paced_externally_;
 
     while(go_) {
-        Glib::Threads::RWLock::ReaderLock lock{data_lock_};
-        //boost::timer::auto_cpu_timer measure_speed(std::cerr,  "do_work: " "%ws wall, %us user + %ss system = %ts CPU (%p%)\n");
-        
-        const pop_t &a = *pop_a_.get();
-        pop_t &b = *pop_b_.get();
-        b = a;
-        color_count.fill(0);
-        for(int y=0;y<grid_height_;++y) {
-            for(int x=0;x<grid_width_;++x) {
-                int pos = x+y*grid_width_;
-                if(a[pos].is_null()) {
-                    continue; // cell is null
-                }
-
-                double w;
-                double weight = a[pos].is_fertile() ? rand_exp(rand, a[pos].fitness) : INFINITY;
-                int pos2 = (x-1)+y*grid_width_;
-                if(x > 0 && a[pos2].is_fertile() && (w = rand_exp(rand, a[pos2].fitness)) < weight ) {
-                    weight = w;
-                    b[pos] = a[pos2];
-                }
-                pos2 = x+(y-1)*grid_width_;
-                if(y > 0 && a[pos2].is_fertile() && (w = rand_exp(rand, a[pos2].fitness)) < weight ) {
-                    weight = w;
-                    b[pos] = a[pos2];
-                }
-                pos2 = (x+1)+y*grid_width_;
-                if(x < grid_width_-1 && a[pos2].is_fertile() && (w = rand_exp(rand, a[pos2].fitness)) < weight ) {
-                    weight = w;
-                    b[pos] = a[pos2];
-                }
-                pos2 = x+(y+1)*grid_width_;
-                if(y < grid_height_-1 && a[pos2].is_fertile() && (w = rand_exp(rand, a[pos2].fitness)) < weight ) {
-                    weight = w;
-                    b[pos] = a[pos2];
-                }
-                color_count[b[pos].color()] += 1;
+        if(paced_externally_) {
+            std::unique_lock<std::mutex> slock{sync_mutex_};
+            auto until = own_clock ? next : clock::now() + stall;
+            bool released = sync_.wait_until(slock, until, [this]{ return due_ > 0 || !go_; });
+            if(!go_) {
+                break;
             }
-        }
-        // Do Mutation
-        int pos  = static_cast<int>(floor(rand_exp(rand,mu_)));
-        if(pos < grid_width_*grid_height_) {
-            // Setup colors since will will have to do at least one mutation
-            empty_colors.clear();
-            for(int color = 0; color < num_alleles; ++color) {
-                if(color_count[color] == 0) 
-                    empty_colors.emplace_back(color);
+            if(released) {
+                due_ -= 1;
+                own_clock = false;
+            } else if(!own_clock) {
+                own_clock = true;
+                next = clock::now();
             }
         }
-        while(pos < grid_width_*grid_height_) {
-            // save pos
-            int opos = pos;
-            pos += static_cast<int>(floor(rand_exp(rand,mu_)));
-            if(!b[opos].is_fertile())
-                continue;
-            // mutate
-            uint64_t r = rand.get_uint64();
-            static_assert(sizeof(mutation)/sizeof(double) == 128, "number of possible mutations is not 128");
-            b[opos].fitness *= mutation[r >> 57]; // use top 7 bits for phenotype
-            r &= 0x01FFFFFFFFFFFFFF;
-            uint64_t color;
-            if(empty_colors.empty()) {
-                // Get the color of the parent
-                color = b[opos].color();
-                // Mutate color so that it does not match the parent
-                color = (color + r % (num_alleles-1)) % num_alleles;
-            } else {
-                // retrieve random empty color and erase it
-                int col = r % empty_colors.size();
-                color = empty_colors[col];
-                if(pos < grid_width_*grid_height_)
-                    empty_colors.erase(empty_colors.begin()+col);                
-            }
-            // Store the allele color in the bottom 8 bits.
-            b[opos].type = (b[opos].type & CELL_FITNESS_MASK) | color;            
-        }
-
-        // Every so often rescale fitnesses to prevent underflow/overflow
-        if((1+gen_) % 10000 == 0) {
-            auto it = std::max_element(b.begin(),b.end());
-            double m = it->fitness;
-            if(m > 1e6) {
-                for(auto &aa : b) {
-                    uint64_t color = aa.color();
-                    aa.fitness = aa.fitness/m + (DBL_EPSILON/2.0);
-                    aa.type = (aa.type & CELL_FITNESS_MASK) | color;
-                }
+        step();
+
+        auto now = clock::now();
+        if(now >= next_report) {
+            char buf[128];
+            std::snprintf(buf, 128, "%0.2fs: Generation %'llu done.\n", elapsed(), gen_);
+            std::cout << buf;
+            std::cout.flush();
+            next_report = now + report_period;
+        }
+        if(!opt_.checkpoint.empty() && now >= next_checkpoint) {
+            save_checkpoint();
+            next_checkpoint = now + checkpoint_period;
+        }
+
+        on_generation();
+        if(rate_ > 0.0 && own_clock) {
+            // do not try to catch up after falling behind
+            next = std::max(next + period, now);
+            if(!paced_externally_) {
+                std::unique_lock<std::mutex> slock{sync_mutex_};
+                sync_.wait_until(slock, next, [this]{ return !go_; });
             }
         }
-        lock.release();
-        swap_buffers();
+    }
 
-        caller->notify_queue_draw();
-        Glib::Threads::Mutex::Lock slock{sync_mutex_};
-        while(!next_generation_) {
-            sync_.wait(sync_mutex_);
+    stop_bands();
+    if(!opt_.checkpoint.empty()) {
+        save_checkpoint(true);
+    }
+}
+
+void Worker::pace_externally() {
+    std::lock_guard<std::mutex> lock{sync_mutex_};
+    paced_externally_ = true;
+}
+
+void Worker::advance(unsigned long long n) {
+    std::lock_guard<std::mutex> lock{sync_mutex_};
+    due_ = n;
+    sync_.notify_one();
+}
+
+void Worker::run(unsigned long long generations, std::function<void()> on_generation) {
+    typedef std::chrono::steady_clock clock;
+    const auto checkpoint_period = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(opt_.checkpoint_interval));
+    auto next_checkpoint = clock::now() + checkpoint_period;
+    const unsigned long long end = gen_ + generations;
+    start_bands();
+    while(gen_ < end) {
+        step();
+        if(on_generation) {
+            on_generation();
+        }
+        if(!opt_.checkpoint.empty() && clock::now() >= next_checkpoint) {
+            save_checkpoint();
+            next_checkpoint = clock::now() + checkpoint_period;
+        }
+    }
+    stop_bands();
+    if(!opt_.checkpoint.empty()) {
+        save_checkpoint(true);
+    }
+}
+
+void Worker::restore(const checkpoint_t &ck) {
+    assert(ck.width == grid_width_ && ck.height == grid_height_);
+    gen_ = ck.generation;
+    rand.set_state(ck.rand_state);
+    *pop_a_ = ck.pop;
+    *pop_b_ = ck.pop;
+    null_cells_.clear();
+    null_cells_.insert(ck.null_cells.begin(), ck.null_cells.end());
+    for(int y=0;y<grid_height_;++y) {
+        update_spans(y);
+    }
+}
+
+void Worker::save_checkpoint(bool wait) {
+    if(checkpoint_busy_ && !wait) {
+        return;
+    }
+    if(checkpoint_thread_.joinable()) {
+        checkpoint_thread_.join();
+    }
+    // Only this thread changes the state, so copying it needs no lock. The
+    // copy is cheap next to a generation; the write is not.
+    auto ck = std::make_shared<checkpoint_t>();
+    ck->width = grid_width_;
+    ck->height = grid_height_;
+    ck->mu = mu_;
+    ck->arg = opt_;
+    ck->generation = gen_;
+    ck->rand_state = rand.get_state();
+    ck->pop = *pop_a_;
+    ck->null_cells.assign(null_cells_.begin(), null_cells_.end());
+
+    checkpoint_busy_ = true;
+    checkpoint_thread_ = std::thread([this,ck]{
+        if(!::save_checkpoint(opt_.checkpoint, *ck)) {
+            std::cerr << "Unable to write checkpoint \"" << opt_.checkpoint << "\"." << std::endl;
+        }
+        checkpoint_busy_ = false;
+    });
+    if(wait) {
+        checkpoint_thread_.join();
+    }
+}
+
+double Worker::elapsed() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now()-start_time_).count();
+}
+
+void snapshot_publisher::publish(const uint8_t *colors, int stride, unsigned long long generation) {
+    snapshot_t &frame = frames_.back();
+    frame.generation = generation;
+    frame.colors.resize(width_*height_);
+    if(last_.empty()) {
+        frame.dirty.assign(tiles_x_*tiles_y_, 1);
+        last_.resize(width_*height_);
+    } else if(frames_.pending()) {
+        // the last frame was never taken and this one replaces it, so its
+        // changes still have to be drawn
+        frame.dirty = last_dirty_;
+    } else {
+        frame.dirty.assign(tiles_x_*tiles_y_, 0);
+    }
+    for(int y=0;y<height_;++y) {
+        const uint8_t *row = colors + y*stride;
+        uint8_t *last = &last_[y*width_];
+        uint8_t *dirty = &frame.dirty[(y/tile_size)*tiles_x_];
+        for(int tx=0;tx<tiles_x_;++tx) {
+            int x0 = tx*tile_size;
+            if(!dirty[tx] && std::memcmp(row+x0, last+x0, std::min(tile_size, width_-x0)) != 0) {
+                dirty[tx] = 1;
+            }
         }
-        next_generation_ = false;
+        std::copy_n(row, width_, last);
+        std::copy_n(row, width_, &frame.colors[y*width_]);
     }
+    last_dirty_ = frame.dirty;
+    frames_.publish();
 }
 
-std::pair<pop_t,unsigned long long> Worker::get_data() {
-    Glib::Threads::RWLock::ReaderLock lock{data_lock_};
-    return {*pop_a_.get(),gen_};
+// The copy costs the worker a pass over the colors per generation, but
+// the display then never waits for a generation or copies a frame itself.
+void Worker::publish() {
+    frames_.publish(&pop_a_->color[pop_a_->index(0,0)], pop_a_->stride, gen_);
 }
 
 void Worker::swap_buffers() {
-    Glib::Threads::RWLock::WriterLock lock{data_lock_};
     gen_ += 1;
     std::swap(pop_a_,pop_b_);
     apply_toggles();
-    char buf[128];
-    std::snprintf(buf, 128, "%0.2fs: Generation %'llu done.\n", timer_.elapsed(), gen_);
-    std::cout << buf;
-    std::cout.flush();
-}
-
-void Worker::do_next_generation() {
-    Glib::Threads::Mutex::Lock lock{sync_mutex_};
-    next_generation_ = true;
-    sync_.signal();
+    pop_a_->fill_border(boundary_);
+    publish();
+    // only this thread touches the populations, so the recorder and the
+    // statistics can copy pop_a_ directly
+    if(recorder_) {
+        recorder_->push(gen_, *pop_a_);
+    }
+    if(stats_ && gen_ % stats_every_ == 0) {
+        stats_->offer(gen_, *pop_a_);
+    }
 }
 
 void Worker::do_clear_nulls() {
-    Glib::Threads::Mutex::Lock lock{toggle_mutex_};
+    std::lock_guard<std::mutex> lock{toggle_mutex_};
     clear_all_nulls_ = true;
 }
 
@@ -178,7 +729,7 @@ bool Worker::is_cell_valid(int x, int y) const {
 }
 
 void Worker::toggle_cell(int x, int y, bool on) {
-    Glib::Threads::Mutex::Lock lock{toggle_mutex_};
+    std::lock_guard<std::mutex> lock{toggle_mutex_};
     if(is_cell_valid(x,y))
         toggle_map_[{x,y}] = on;
 }
@@ -191,7 +742,7 @@ template <typename T> int sgn(T val) {
 // toggle a line beginning at {x1,y1} and ending at {x2,y2}
 // assumes that {x1,y1} has already been toggled
 void Worker::toggle_line(int x1, int y1, int x2, int y2, bool on) {
-    Glib::Threads::Mutex::Lock lock{toggle_mutex_};
+    std::lock_guard<std::mutex> lock{toggle_mutex_};
     int dx = x2 - x1;
     int dy = y2 - y1;
     if(dx == 0 && dy == 0) {
@@ -219,7 +770,7 @@ void Worker::toggle_line(int x1, int y1, int x2, int y2, bool on) {
 }
 
 void Worker::toggle_cells(const barriers_t & cells, bool on) {
-    Glib::Threads::Mutex::Lock lock{toggle_mutex_};
+    std::lock_guard<std::mutex> lock{toggle_mutex_};
     for(auto &&a : cells) {
         int x = a.first;
         int y = a.second;
@@ -235,8 +786,24 @@ const std::pair<int,int> erase_area_[] = {
 };
 
 void Worker::apply_toggles() {
-    Glib::Threads::Mutex::Lock lock{toggle_mutex_};
+    std::lock_guard<std::mutex> lock{toggle_mutex_};
     pop_t &a = *pop_a_.get();
+    pop_t &b = *pop_b_.get();
+
+    // Null cells are never written by the kernel, so toggles go to both
+    // buffers. The spans of every row touched are rebuilt afterwards.
+    std::vector<int> rows;
+    auto toggle = [&](int x, int y, bool on) {
+        int pos = a.index(x,y);
+        if(on) {
+            a.toggle_on(pos);
+            b.toggle_on(pos);
+        } else {
+            a.toggle_off(pos);
+            b.toggle_off(pos);
+        }
+        rows.push_back(y);
+    };
 
     if(clear_all_nulls_) {
         toggle_map_.clear();
@@ -244,11 +811,10 @@ void Worker::apply_toggles() {
             int x = pos.first;
             int y = pos.second;
             assert(is_cell_valid(x,y));
-            a[x+y*grid_width_].toggle_off();
+            toggle(x, y, false);
         }
         null_cells_.clear();
         clear_all_nulls_ = false;
-        return;
     }
     for(auto && cell : toggle_map_) {
     	int x = cell.first.first;
@@ -256,17 +822,44 @@ void Worker::apply_toggles() {
         assert(is_cell_valid(x,y));
     	if(cell.second) {
             null_cells_.insert(cell.first);
-    		a[x+y*grid_width_].toggle_on();
+    		toggle(x, y, true);
     	} else if(null_cells_.erase(cell.first) > 0) {
-    		a[x+y*grid_width_].toggle_off();
+    		toggle(x, y, false);
     	} else {
             for(auto && off : erase_area_) {
                 if(null_cells_.erase({cell.first.first+off.first,cell.first.second+off.second}) > 0) {
-                    a[(x+off.first)+(y+off.second)*grid_width_].toggle_off();
+                    toggle(x+off.first, y+off.second, false);
                     break;
                 }
             }
         }
     }
     toggle_map_.clear();
+
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+    for(int y : rows) {
+        update_spans(y);
+    }
+}
+
+void Worker::update_spans(int y) {
+    const pop_t &a = *pop_a_.get();
+    const uint8_t *color = a.color.data()+a.index(0,y);
+    row_spans_t &spans = spans_[y];
+    spans.clear();
+    int x = 0;
+    for(;;) {
+        while(x < grid_width_ && color[x] == null_allele) {
+            ++x;
+        }
+        if(x == grid_width_) {
+            break;
+        }
+        int x0 = x;
+        while(x < grid_width_ && color[x] != null_allele) {
+            ++x;
+        }
+        spans.push_back({x0, x});
+    }
 }
@@ -1,19 +1,25 @@
 #ifndef CARTWRIGHT_WORKER_H
 #define CARTWRIGHT_WORKER_H
 
-#include <gtkmm.h>
-
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <set>
+#include <string>
 
 #include <boost/timer/timer.hpp>
 
+#include "triple_buffer.h"
 #include "xorshift64.h"
 
-class Sim1942;
-
 struct color_rgb {
   double red;
   double green;
@@ -87,69 +93,256 @@ constexpr size_t num_colors = sizeof(col_set)/sizeof(color_rgb);
 constexpr size_t num_alleles = num_colors-2;
 constexpr size_t null_allele = num_colors-1;
 
-#define CELL_TYPE_MASK UINT64_C(0xFF)
-#define CELL_FITNESS_MASK (~CELL_TYPE_MASK)
+constexpr uint8_t default_color = 10;
+
+static_assert(null_allele < num_colors && null_allele <= UINT8_MAX, "Null allele is invalid.");
+static_assert(default_color < num_alleles, "Default color is invalid.");
 
-static_assert(null_allele < num_colors && null_allele <= CELL_TYPE_MASK , "Null allele is invalid.");
+typedef std::vector<uint8_t> colors_t;
 
-union cell {
-    cell() {
-        fitness = 1.0;
-        constexpr uint64_t color = 10;
-        static_assert(color < num_alleles, "Default color is invalid.");
-        type = (type & CELL_FITNESS_MASK) | (color & CELL_TYPE_MASK);
-    };
-    double fitness;
-    uint64_t type;
+// Frames track changes in tiles of tile_size x tile_size cells.
+constexpr int tile_size = 16;
+
+// The colors of a finished generation, as handed to the display.
+struct snapshot_t {
+    colors_t colors;
+    unsigned long long generation{0};
+    // One flag per tile, row by row, set where the frame may differ from
+    // the one the reader took before it.
+    std::vector<uint8_t> dirty;
+};
 
-    bool is_null() const {
-        return (color() == null_allele);
+// Publishes snapshots of a grid from one writer thread to one reader
+// thread through a triple buffer. Frames the reader never took pass their
+// dirty tiles on to the next one, so a reader that only redraws dirty
+// tiles stays correct however many frames it misses.
+class snapshot_publisher {
+public:
+    snapshot_publisher(int width, int height) : width_{width}, height_{height},
+        tiles_x_{(width+tile_size-1)/tile_size}, tiles_y_{(height+tile_size-1)/tile_size}
+    { }
+
+    int tiles_x() const {
+        return tiles_x_;
     }
-    bool is_fertile() const {
-        return (color() < null_allele-1);
+    int tiles_y() const {
+        return tiles_y_;
     }
-    void toggle_on() {
-        type = (type & CELL_FITNESS_MASK) | null_allele;
+
+    // Writer side: publish the grid whose row y starts at colors+y*stride.
+    // The first frame is dirty everywhere.
+    void publish(const uint8_t *colors, int stride, unsigned long long generation);
+
+    // Reader side; see triple_buffer::front.
+    const snapshot_t& latest() {
+        return frames_.front();
     }
-    void toggle_off() {
-        type = (type & CELL_FITNESS_MASK) | (null_allele-1);
+    bool pending() const {
+        return frames_.pending();
     }
-    void toggle() {
-        if(is_null()) {
-            toggle_off();
-        } else {
-            toggle_on();
+
+private:
+    int width_, height_;
+    int tiles_x_, tiles_y_;
+    triple_buffer<snapshot_t> frames_;
+    // owned by the writer: the colors and dirty tiles of the last frame
+    colors_t last_;
+    std::vector<uint8_t> last_dirty_;
+};
+
+// What lies beyond the edges of the grid. absorbing edges are null cells;
+// torus wraps around to the opposite edge; reflect mirrors the edge cells.
+enum class boundary_t { absorbing, torus, reflect };
+
+bool boundary_from_name(const std::string &name, boundary_t *boundary);
+const char* boundary_name(boundary_t boundary);
+
+// A population is stored as two planes: the color (allele) of every cell
+// and its fitness. Color-only passes only have to touch the first one.
+// The planes have a one-cell border around the grid, so the neighbors of
+// every cell can be read without bounds checks. Cell {x,y} is at
+// index(x,y), and its vertical neighbors are stride cells away. The border
+// starts out null; fill_border copies edge cells into it for the other
+// boundary conditions.
+struct pop_t {
+    pop_t() = default;
+    pop_t(int width, int height) : width{width}, height{height}, stride{width+2},
+        color((width+2)*(height+2), null_allele), fitness((width+2)*(height+2), 1.0)
+    {
+        for(int y=0;y<height;++y) {
+            std::fill_n(color.begin()+index(0,y), width, default_color);
         }
     }
 
-    uint64_t color() const {
-        return type & CELL_TYPE_MASK;
+    size_t index(int x, int y) const {
+        return (x+1)+(y+1)*stride;
     }
 
-    bool operator<(cell other) {
-        return fitness < other.fitness;
+    bool is_null(size_t pos) const {
+        return (color[pos] == null_allele);
     }
+    bool is_fertile(size_t pos) const {
+        return (color[pos] < null_allele-1);
+    }
+    void toggle_on(size_t pos) {
+        color[pos] = null_allele;
+    }
+    void toggle_off(size_t pos) {
+        color[pos] = null_allele-1;
+    }
+
+    // Refresh the border from the grid according to boundary.
+    void fill_border(boundary_t boundary);
+
+    // Copy the colors of the grid, without the border, into out.
+    void get_colors(colors_t *out) const {
+        out->resize(width*height);
+        for(int y=0;y<height;++y) {
+            std::copy_n(color.begin()+index(0,y), width, out->begin()+y*width);
+        }
+    }
+
+    int width{0};
+    int height{0};
+    int stride{0};
+    colors_t color;
+    std::vector<double> fitness;
 };
 
-typedef std::vector<cell> pop_t;
+// The non-null cells [x0,x1) of a row. The kernels only visit these, so
+// rows that are mostly barrier cost little.
+struct span_t {
+    int x0, x1;
+};
+typedef std::vector<span_t> row_spans_t;
+
 typedef std::vector<std::pair<int,int>> barriers_t;
+typedef std::array<int,num_colors> color_count_t;
+
+// Generation kernels; automatic picks the widest one the CPU supports.
+enum class kernel_t { automatic, scalar, avx2, avx512 };
+
+bool kernel_from_name(const std::string &name, kernel_t *kernel);
+const char* kernel_name(kernel_t kernel);
+// Whether kernel was compiled in and this CPU runs it. The Makefile builds
+// with -march=native, so the compiler may use the build host's vector
+// instructions anywhere; the binary is only meant for CPUs like that host.
+bool kernel_available(kernel_t kernel);
+
+// How a cell picks the neighbor that colonizes it. race runs an exponential
+// race among the fertile candidates; draw picks one of them directly with a
+// single uniform draw, with probability proportional to fitness.
+enum class engine_t { race, draw };
+
+bool engine_from_name(const std::string &name, engine_t *engine);
+const char* engine_name(engine_t engine);
+
+// Which cells compete to colonize a cell: the four orthogonal neighbors,
+// all eight surrounding cells, or the six neighbors on a hexagonal lattice.
+enum class neighborhood_t { von_neumann, moore, hex };
+
+bool neighborhood_from_name(const std::string &name, neighborhood_t *neighborhood);
+const char* neighborhood_name(neighborhood_t neighborhood);
+
+// Shape of the long-range dispersal kernel; none keeps competition local.
+enum class dispersal_t { none, gaussian, exponential };
+
+bool dispersal_from_name(const std::string &name, dispersal_t *dispersal);
+const char* dispersal_name(dispersal_t dispersal);
+
+struct checkpoint_t;
+
+// Options that control how the generation engine runs.
+struct worker_arg_t {
+    int threads = 1;
+    kernel_t kernel = kernel_t::automatic;
+    engine_t engine = engine_t::race;
+    neighborhood_t neighborhood = neighborhood_t::von_neumann;
+    boundary_t boundary = boundary_t::absorbing;
+    // Parents are drawn from the dispersal kernel instead of the fixed
+    // neighbors, as many per cell as the neighborhood has neighbors.
+    dispersal_t dispersal = dispersal_t::none;
+    double dispersal_radius = 2.0;
+    double jump_rate = 0.0;
+    // Target generations per second of do_work; 0 runs as fast as possible.
+    double rate = 15.0;
+    // Seed of a reproducible run; 0 seeds from the pid and the clock.
+    uint64_t seed = 0;
+    // If not empty, the state is saved here every checkpoint_interval
+    // seconds and when the worker stops.
+    std::string checkpoint;
+    double checkpoint_interval = 300.0;
+    // Continue from this state instead of a fresh grid.
+    std::shared_ptr<const checkpoint_t> resume;
+    // If not empty, every generation is recorded here, with the whole grid
+    // every record_keyframes generations.
+    std::string record;
+    int record_keyframes = 300;
+    // If not empty, statistics of every stats_every-th generation are
+    // written here as CSV, at most one row per stats_interval seconds.
+    std::string stats;
+    int stats_every = 1;
+    double stats_interval = 0.1;
+};
+
+// The options of worker.xmh, as mcmxlii and mcmxlii-headless parse them.
+struct worker_options_t {
+#define XM(lname, sname, desc, type, def) type XV(lname) ;
+# include "worker.xmh"
+#undef XM
+};
+
+// Check the options and fill in a worker_arg_t, printing what is wrong to
+// std::cerr if they are not valid. With --resume, the checkpoint is loaded
+// here and its size and mutation rate replace those in options.
+bool make_worker_arg(worker_options_t *options, worker_arg_t *arg);
+
+class dispersal_kernel;
+class recorder;
+class stats_pipeline;
 
 class Worker
 {
 public:
-    Worker(int width, int height, double mu, int delay=0);
-
-    // Thread function.
-    void do_work(Sim1942* caller);
+    Worker(int width, int height, double mu, int delay=0, const worker_arg_t &opt = worker_arg_t());
+    ~Worker();
+
+    // Thread function. Runs generations at the target rate until stopped and
+    // calls on_generation after each one. The callback must not block.
+    void do_work(std::function<void()> on_generation);
+
+    // Make do_work run the generations released by advance instead of
+    // pacing itself, so a display can time generations by its frame clock.
+    // If nothing is released for a while, such as when the display stops
+    // drawing, do_work keeps the rate by itself until advance is called
+    // again. Call before do_work starts.
+    void pace_externally();
+    // Let do_work run the next n generations. Generations still due from an
+    // earlier call are dropped, so a slow worker never bursts.
+    void advance(unsigned long long n = 1);
+
+    // Run the given number of generations back to back on the calling thread,
+    // calling on_generation, if set, after each one.
+    void run(unsigned long long generations, std::function<void()> on_generation = nullptr);
+
+    // The newest finished generation, published without locks. It stays
+    // valid until the next call, and only one thread may call this.
+    const snapshot_t& latest() {
+        return frames_.latest();
+    }
+    // Whether a generation was published since the last call to latest.
+    bool pending() const {
+        return frames_.pending();
+    }
 
-    std::pair<pop_t,unsigned long long> get_data();
+    // Seconds since the worker was created.
+    double elapsed() const;
 
     void swap_buffers();
 
     void stop();
 
     // Synchronizes access to member data.
-    void do_next_generation();
     void do_clear_nulls();
 
     void toggle_cell(int x, int y, bool on);
@@ -159,9 +352,36 @@ public:
 
 protected:
     void apply_toggles();
+    // Rebuild the spans of row y from pop_a_.
+    void update_spans(int y);
+
+    // Start and stop the helper threads of the bands.
+    void start_bands();
+    void stop_bands();
+    // Compute the next generation into pop_b_ and make it current.
+    void step();
+    // Copy the colors of pop_a_ into a frame and publish it.
+    void publish();
+
+    // Load a saved state before the worker starts.
+    void restore(const checkpoint_t &ck);
+    // Copy the current state and write it to the checkpoint file on a
+    // background thread. Skipped while the previous write is still running,
+    // unless wait is set, which also waits for the write to finish.
+    void save_checkpoint(bool wait = false);
+
+    // Update rows [y0,y1) of pop_b_ from pop_a_.
+    void update_rows(int y0, int y1, xorshift64 &rand, xorshift64x8 &lanes,
+        color_count_t &color_count);
+    // Update the rows of a band and record its color census.
+    void update_band(int band);
+    // Run every band of a generation and wait for them to finish.
+    void run_bands();
+    // Thread function of the helper threads.
+    void band_thread(int band);
 
 private:
-    Glib::Timer timer_;
+    std::chrono::steady_clock::time_point start_time_{std::chrono::steady_clock::now()};
 
     std::atomic<bool> go_{false};
 
@@ -170,17 +390,48 @@ private:
     double mu_;
     unsigned long long gen_;
     int delay_;
+    double rate_;
+    uint64_t seed_;
+    // the options the worker was created with, for checkpoints
+    worker_arg_t opt_;
 
     std::unique_ptr<pop_t> pop_a_;
     std::unique_ptr<pop_t> pop_b_;
+    std::vector<row_spans_t> spans_;
 
     xorshift64 rand;
 
-    Glib::Threads::Cond sync_;
-    Glib::Threads::Mutex sync_mutex_, toggle_mutex_;
-    Glib::Threads::RWLock data_lock_;
+    kernel_t kernel_;
+    engine_t engine_;
+    neighborhood_t neighborhood_;
+    boundary_t boundary_;
+    std::unique_ptr<dispersal_kernel> dispersal_;
+
+    // Each band of rows has its own random stream and color census.
+    int num_bands_;
+    std::vector<xorshift64> band_rand_;
+    std::vector<xorshift64x8> band_lanes_;
+    std::vector<color_count_t> band_count_;
+    color_count_t color_count_;
+    std::vector<int> empty_colors_;
+
+    std::vector<std::thread> band_threads_;
+    std::condition_variable band_start_, band_done_;
+    std::mutex band_mutex_;
+    unsigned long long band_round_{0};
+    int bands_pending_{0};
+    bool band_go_{false};
+
+    std::condition_variable sync_;
+    std::mutex sync_mutex_, toggle_mutex_;
+    // set before do_work starts
+    bool paced_externally_{false};
+    // guarded by sync_mutex_
+    unsigned long long due_{0};
+
+    // written by the thread running the generations, read by the display
+    snapshot_publisher frames_;
 
-    bool next_generation_{false};
     bool clear_all_nulls_{false};
 
     typedef std::map<std::pair<int,int>,bool> toggle_map_t;
@@ -188,6 +439,13 @@ private:
 
     typedef std::set<std::pair<int,int>> null_cells_t;
     null_cells_t null_cells_;
+
+    std::unique_ptr<recorder> recorder_;
+    std::unique_ptr<stats_pipeline> stats_;
+    int stats_every_;
+
+    std::thread checkpoint_thread_;
+    std::atomic<bool> checkpoint_busy_{false};
 };
 
 #endif // GTKMM_EXAMPLEWORKER_H
\ No newline at end of file
@@ -34,6 +34,7 @@
 
 #include <cfloat>
 #include <cstdint>
+#include <ctime>
 #include <algorithm>
 
 #if __cpluscplus >= 201103L
@@ -77,6 +78,35 @@ public:
 	std::pair<uint64_t,uint64_t> get_state() const {
 		return std::make_pair(u,w);
 	}
+
+	// Restore a state from get_state(); unlike seed() there is no burn in.
+	void set_state(std::pair<uint64_t,uint64_t> p) {
+		u = p.first;
+		w = p.second;
+	}
+
+	// Advance the generator as if get_raw() had been called n times.
+	// The xorshift step is linear over GF(2), so its n-th power is found by
+	// repeated squaring of its 64x64 bit matrix.
+	void jump(uint64_t n) {
+		uint64_t m[64], r[64], t[64];
+		for(int j=0;j<64;++j) {
+			m[j] = xorshift(UINT64_C(1) << j);
+			r[j] = UINT64_C(1) << j;
+		}
+		w += n*UINT64_C(0x61C8864680B583EB);
+		for(; n != 0; n >>= 1) {
+			if(n & 1) {
+				for(int j=0;j<64;++j)
+					t[j] = gf2_apply(m, r[j]);
+				std::copy(t, t+64, r);
+			}
+			for(int j=0;j<64;++j)
+				t[j] = gf2_apply(m, m[j]);
+			std::copy(t, t+64, m);
+		}
+		u = gf2_apply(r, u);
+	}
 	
 	// Xorshift + Weyl Generator + some extra magic for low bits
 	uint64_t get_raw() {
@@ -185,9 +215,92 @@ public:
 	}
 	
 private:
+	static uint64_t xorshift(uint64_t x) {
+		x ^= (x << 5); x ^= (x >> 15); x ^= (x << 27);
+		return x;
+	}
+
+	// multiply the bit matrix with columns m by the bit vector x
+	static uint64_t gf2_apply(const uint64_t *m, uint64_t x) {
+		uint64_t y = 0;
+		for(int j=0; x != 0; ++j, x >>= 1) {
+			if(x & 1)
+				y ^= m[j];
+		}
+		return y;
+	}
+
 	uint64_t u,w;
 };
 
+/*
+N xorshift64 generators that are stepped together, one per SIMD lane.
+Lane i is the scalar generator jumped ahead by i*2^58 draws, so the lanes are
+non-overlapping pieces of the same sequence and keep its statistical quality.
+The per-lane state is public so that vector code can hold it in registers.
+*/
+
+template<int N>
+class xorshift64_lanes {
+public:
+	static constexpr int lanes = N;
+
+	xorshift64_lanes(uint64_t seed1 = 0, uint64_t seed2 = 0) {
+		seed(seed1,seed2);
+	}
+
+	void seed(uint64_t seed1 = 0, uint64_t seed2 = 0) {
+		xorshift64 g(seed1,seed2);
+		for(int i=0;i<N;++i) {
+			set_state(i, g.get_state());
+			g.jump(UINT64_C(1) << 58);
+		}
+	}
+
+	std::pair<uint64_t,uint64_t> get_state(int lane) const {
+		return std::make_pair(u[lane],w[lane]);
+	}
+
+	void set_state(int lane, std::pair<uint64_t,uint64_t> p) {
+		u[lane] = p.first;
+		w[lane] = p.second;
+	}
+
+	// One draw from every lane
+	void get_raw(uint64_t *out) {
+		// work on copies so that out cannot alias the state
+		uint64_t x[N], y[N];
+		for(int i=0;i<N;++i) {
+			x[i] = u[i]; x[i] ^= (x[i] << 5); x[i] ^= (x[i] >> 15); x[i] ^= (x[i] << 27);
+			y[i] = w[i] + UINT64_C(0x61C8864680B583EB);
+			u[i] = x[i];
+			w[i] = y[i];
+		}
+		for(int i=0;i<N;++i)
+			out[i] = x[i]+(y[i]^(y[i]>>27));
+	}
+
+	void get_uint64(uint64_t *out) {
+		get_raw(out);
+	}
+
+	// Uniform (0,1) from every lane
+	void get_double52(double *out) {
+		uint64_t r[N];
+		get_raw(r);
+		for(int i=0;i<N;++i) {
+			union { uint64_t u; double d; } a;
+			a.u = (r[i] >> 12) | UINT64_C(0x3FF0000000000000);
+			out[i] = a.d-(1.0-(DBL_EPSILON/2.0));
+		}
+	}
+
+	uint64_t u[N], w[N];
+};
+
+typedef xorshift64_lanes<4> xorshift64x4;
+typedef xorshift64_lanes<8> xorshift64x8;
+
 inline unsigned int create_random_seed() {
 	// start with some well mixed bits
 	unsigned int v = 0x6ba658b3;	